@@ -0,0 +1,184 @@
+/*
+** Collett – Format Codec Benchmark
+** ================================
+**
+** This file is a part of Collett
+** Copyright 2020–2024, Veronica Berglyd Olsen
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "formatcodec.h"
+
+// Blocks in the sample document, and rounds run of each benchmark
+#define COL_BENCH_BLOCKS 100000
+#define COL_BENCH_ROUNDS 5
+
+#include <algorithm>
+#include <limits>
+
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QString>
+#include <QStringView>
+#include <QTextStream>
+
+using namespace Collett;
+
+namespace {
+
+/**!
+ * @brief Build a sample document in format version 1.
+ *
+ * Every tenth block is a heading, and the paragraphs mix plain, bold and
+ * italic fragments.
+ */
+QJsonArray sampleContent() {
+
+    QJsonArray content;
+    for (int i = 0; i < COL_BENCH_BLOCKS; i++) {
+        QJsonObject block;
+        if (i % 10 == 0) {
+            block[QLatin1String("u:fmt")] = QLatin1String("h2:ac");
+            block[QLatin1String("u:txt")] = QString("t|Chapter %1").arg(i / 10 + 1);
+        } else {
+            block[QLatin1String("u:fmt")] = QLatin1String("p:al:ti");
+            block[QLatin1String("x:txt")] = QJsonArray({
+                QLatin1String("t|The quick brown fox jumps over the "),
+                QLatin1String("t:b|lazy dog"),
+                QLatin1String("t|, and then it runs off into the "),
+                QLatin1String("t:i|dark forest"),
+                QLatin1String("t|."),
+            });
+        }
+        content.append(block);
+    }
+
+    return content;
+}
+
+/**!
+ * @brief Decode the block and fragment formats of a list of blocks.
+ *
+ * @return a checksum of the decoded formats.
+ */
+quint64 decodeContent(const QJsonArray &content) {
+
+    quint64 checksum = 0;
+    for (const QJsonValue &jBlock : content) {
+        QJsonObject block = jBlock.toObject();
+        checksum += FormatCodec::decodeBlockValue(block.value(QLatin1String("u:fmt")));
+
+        QJsonValue jText = block.value(QLatin1String("u:txt"));
+        QJsonArray jFrags = jText.isString() ? QJsonArray({jText}) : block.value(QLatin1String("x:txt")).toArray();
+        for (const QJsonValue &jFrag : jFrags) {
+            quint32 charFmt = 0;
+            checksum += FormatCodec::splitFragment(jFrag.toString(), charFmt) + charFmt;
+        }
+    }
+
+    return checksum;
+}
+
+/**!
+ * @brief Encode the fragments of a list of version 2 blocks again.
+ *
+ * @return a checksum of the encoded fragments.
+ */
+quint64 encodeContent(const QJsonArray &content) {
+
+    quint64 checksum = 0;
+    for (const QJsonValue &jBlock : content) {
+        QJsonObject block = jBlock.toObject();
+        QJsonValue jText = block.value(QLatin1String("u:txt"));
+        QJsonArray jFrags = jText.isString() ? QJsonArray({jText}) : block.value(QLatin1String("x:txt")).toArray();
+        for (const QJsonValue &jFrag : jFrags) {
+            QString fragment = jFrag.toString();
+            quint32 charFmt = 0;
+            qsizetype pos = FormatCodec::splitFragment(fragment, charFmt);
+            checksum += FormatCodec::encodeFragment(charFmt, QStringView(fragment).sliced(pos + 1)).size();
+        }
+    }
+
+    return checksum;
+}
+
+/**!
+ * @brief Convert a list of blocks to the current format version.
+ */
+QJsonArray migrateContent(const QJsonArray &content) {
+    QJsonArray result;
+    for (const QJsonValue &jBlock : content) {
+        result.append(FormatCodec::migrateBlock(jBlock.toObject()));
+    }
+    return result;
+}
+
+/**!
+ * @brief Run a benchmark and print the best time per block.
+ */
+template <typename Function>
+void runBench(QTextStream &out, const QString &name, Function run) {
+
+    qint64 best = std::numeric_limits<qint64>::max();
+    quint64 checksum = 0;
+    for (int round = 0; round < COL_BENCH_ROUNDS; round++) {
+        QElapsedTimer timer;
+        timer.start();
+        checksum = run();
+        best = std::min(best, timer.nsecsElapsed());
+    }
+
+    out << qSetFieldWidth(24) << Qt::left << name << qSetFieldWidth(10) << Qt::right
+        << QString::number(double(best) / COL_BENCH_BLOCKS, 'f', 1) << qSetFieldWidth(0)
+        << " ns/block  (checksum " << checksum << ")" << Qt::endl;
+}
+
+} // namespace
+
+/**
+ * Benchmark Entry Point
+ * =====================
+ * Times the format codec on a generated document, so changes to the codec
+ * and the format versions can be compared. Each benchmark is run a few
+ * times, and the fastest round is reported.
+ */
+
+int main() {
+
+    QTextStream out(stdout);
+
+    QJsonArray contentV1 = sampleContent();
+    QJsonArray contentV2 = migrateContent(contentV1);
+
+    out << "Format codec benchmark, " << COL_BENCH_BLOCKS << " blocks, best of "
+        << COL_BENCH_ROUNDS << " rounds" << Qt::endl;
+
+    runBench(out, "decode version 1", [&contentV1]() {
+        return decodeContent(contentV1);
+    });
+    runBench(out, "decode version 2", [&contentV2]() {
+        return decodeContent(contentV2);
+    });
+    runBench(out, "encode version 2", [&contentV2]() {
+        return encodeContent(contentV2);
+    });
+    runBench(out, "migrate 1 to 2", [&contentV1]() {
+        return static_cast<quint64>(migrateContent(contentV1).size());
+    });
+
+    return 0;
+}
@@ -0,0 +1,80 @@
+#
+# Collett – Icon Table Generator
+# ==============================
+#
+# This file is a part of Collett
+# Copyright 2020–2024, Veronica Berglyd Olsen
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+# General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program. If not, see <https://www.gnu.org/licenses/>.
+#
+# Converts the SVG icons in ICON_DIR into a constexpr table in OUTPUT. Each
+# icon must have a viewBox starting at 0 0 and a single path. Usage:
+#
+#   cmake -DICON_DIR=<dir> -DOUTPUT=<file> -P icontable.cmake
+#
+
+file(GLOB ICON_FILES "${ICON_DIR}/*.svg")
+list(SORT ICON_FILES)
+
+set(ICON_ENTRIES "")
+foreach(ICON_FILE ${ICON_FILES})
+    get_filename_component(ICON_NAME ${ICON_FILE} NAME_WE)
+    file(READ ${ICON_FILE} ICON_SVG)
+
+    string(REGEX MATCH "viewBox=\"0 0 ([0-9]+) ([0-9]+)\"" _ "${ICON_SVG}")
+    if(NOT CMAKE_MATCH_1 OR NOT CMAKE_MATCH_2)
+        message(FATAL_ERROR "No viewBox found in icon: ${ICON_FILE}")
+    endif()
+    set(ICON_BOX "${CMAKE_MATCH_1} ${CMAKE_MATCH_2}")
+
+    string(REGEX MATCH "<path d=\"([^\"]+)\"" _ "${ICON_SVG}")
+    if(NOT CMAKE_MATCH_1)
+        message(FATAL_ERROR "No path found in icon: ${ICON_FILE}")
+    endif()
+    set(ICON_PATH "${CMAKE_MATCH_1}")
+
+    string(APPEND ICON_ENTRIES
+        "    {\"${ICON_NAME}\",\n"
+        "     \"<svg xmlns='http://www.w3.org/2000/svg' viewBox='0 0 ${ICON_BOX}'\",\n"
+        "     \"><path d='${ICON_PATH}'/></svg>\"},\n"
+    )
+endforeach()
+
+file(WRITE "${OUTPUT}.tmp"
+    "// Generated from ${ICON_DIR} by icontable.cmake. Do not edit.\n"
+    "\n"
+    "#ifndef COLLETT_ICON_TABLE_H\n"
+    "#define COLLETT_ICON_TABLE_H\n"
+    "\n"
+    "namespace Collett {\n"
+    "\n"
+    "struct IconData {\n"
+    "    const char *name;\n"
+    "    const char *head;\n"
+    "    const char *body;\n"
+    "};\n"
+    "\n"
+    "// Sorted by name\n"
+    "constexpr IconData ICON_TABLE[] = {\n"
+    "${ICON_ENTRIES}"
+    "};\n"
+    "\n"
+    "} // namespace Collett\n"
+    "\n"
+    "#endif // COLLETT_ICON_TABLE_H\n"
+)
+
+# Only touch the output if it changed, to avoid needless rebuilds
+execute_process(COMMAND ${CMAKE_COMMAND} -E copy_if_different "${OUTPUT}.tmp" "${OUTPUT}")
+file(REMOVE "${OUTPUT}.tmp")
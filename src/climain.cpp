@@ -0,0 +1,546 @@
+/*
+** Collett – CLI Main Class
+** ========================
+**
+** This file is a part of Collett
+** Copyright 2020–2024, Veronica Berglyd Olsen
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "climain.h"
+#include "contenttable.h"
+#include "exporter.h"
+#include "formatcodec.h"
+#include "project.h"
+
+#include <cstdio>
+
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QStringView>
+
+namespace Collett {
+
+/**
+ * Command Line Interface
+ * ======================
+ * Runs a single command on one or more projects without the GUI. Only the
+ * core classes are used, so no widgets, icons or style sheets are loaded,
+ * and the commands run without a display.
+ *
+ * Results are written to stdout and errors to stderr. The exit code is 0 on
+ * success, 1 if a command failed, and 2 for invalid arguments.
+ */
+
+CliMain::CliMain(QObject *parent) : QObject(parent), m_out(stdout), m_err(stderr) {}
+
+/**
+ * Class Methods
+ * =============
+ */
+
+/**!
+ * @brief Run the command given on the command line.
+ *
+ * @param arguments the application arguments, with the command second.
+ * @return the exit code.
+ */
+int CliMain::run(const QStringList &arguments) {
+
+    if (arguments.size() < 2) {
+        this->printUsage();
+        return 2;
+    }
+
+    // The command is passed to its own parser as part of the program name,
+    // so that the help text shows the full command
+    QString command = arguments.at(1);
+    QStringList cmdArgs = arguments.mid(2);
+    cmdArgs.prepend(arguments.at(0) + " " + command);
+
+    int result = 2;
+    if (command == "convert") {
+        result = this->runConvert(cmdArgs);
+    } else if (command == "stats") {
+        result = this->runStats(cmdArgs);
+    } else if (command == "export") {
+        result = this->runExport(cmdArgs);
+    } else if (command == "validate") {
+        result = this->runValidate(cmdArgs);
+    } else {
+        this->printUsage();
+    }
+
+    m_out.flush();
+    m_err.flush();
+
+    return result;
+}
+
+/**
+ * Static Methods
+ * ==============
+ */
+
+/**!
+ * @brief Check if a command line argument is a CLI command.
+ */
+bool CliMain::isCommand(const QString &name) {
+    return name == "convert" || name == "stats" || name == "export" || name == "validate";
+}
+
+/**!
+ * @brief Check if a command needs a GUI application.
+ *
+ * Only PDF export needs one, for the fonts used to lay out the text. This
+ * is called before any application exists, so it only parses the arguments
+ * and leaves all error reporting to the command itself.
+ *
+ * @param arguments the application arguments, with the command second.
+ */
+bool CliMain::needsGui(const QStringList &arguments) {
+
+    if (arguments.size() < 2 || arguments.at(1) != "export") {
+        return false;
+    }
+
+    QCommandLineParser parser;
+    CliMain::addExportOptions(parser);
+    if (!parser.parse(arguments.mid(1)) || parser.positionalArguments().size() != 2) {
+        return false;
+    }
+
+    Exporter::Format format = Exporter::formatForPath(parser.positionalArguments().at(1));
+    if (parser.isSet("format") && !Exporter::parseFormat(parser.value("format"), format)) {
+        return false;
+    }
+
+    return format == Exporter::Format::Pdf;
+}
+
+/**
+ * Commands
+ * ========
+ */
+
+/**!
+ * @brief Convert a project to another storage format.
+ *
+ * The storage format is given by the extension of the target path.
+ */
+int CliMain::runConvert(const QStringList &arguments) {
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(tr(
+        "Convert a project to the storage format given by the target extension: "
+        ".collett (archive), .fcollett (flat JSON) or .bcollett (flat CBOR)."
+    ));
+    parser.addHelpOption();
+    parser.addPositionalArgument("source", tr("The project to convert."));
+    parser.addPositionalArgument("target", tr("The path of the converted project."));
+
+    if (!parser.parse(arguments) || parser.positionalArguments().size() != 2) {
+        m_err << (parser.errorText().isEmpty() ? parser.helpText() : parser.errorText()) << Qt::endl;
+        return 2;
+    }
+    if (parser.isSet("help")) {
+        m_out << parser.helpText();
+        return 0;
+    }
+
+    QString source = parser.positionalArguments().at(0);
+    QString target = parser.positionalArguments().at(1);
+    QString error;
+    if (!Project::convertProject(source, target, error)) {
+        m_err << error << Qt::endl;
+        return 1;
+    }
+
+    m_out << tr("Converted %1 to %2").arg(source, target) << Qt::endl;
+    return 0;
+}
+
+/**!
+ * @brief Print block, heading, word and character counts of projects.
+ */
+int CliMain::runStats(const QStringList &arguments) {
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(tr("Print text statistics of one or more projects."));
+    parser.addHelpOption();
+    QCommandLineOption jsonOption("json", tr("Print one JSON object per project."));
+    parser.addOption(jsonOption);
+    parser.addPositionalArgument("projects", tr("The projects to count."), "<project>...");
+
+    if (!parser.parse(arguments) || parser.positionalArguments().isEmpty()) {
+        m_err << (parser.errorText().isEmpty() ? parser.helpText() : parser.errorText()) << Qt::endl;
+        return 2;
+    }
+    if (parser.isSet("help")) {
+        m_out << parser.helpText();
+        return 0;
+    }
+
+    bool asJson = parser.isSet(jsonOption);
+    if (!asJson) {
+        m_out << "project\tblocks\theadings\twords\tchars" << Qt::endl;
+    }
+
+    int result = 0;
+    for (const QString &path : parser.positionalArguments()) {
+
+        Project project;
+        if (!this->openProject(project, path)) {
+            result = 1;
+            continue;
+        }
+
+        // Archive entries with a content table are counted from the mapped
+        // table, without parsing their JSON
+        TextStats stats;
+        for (int i = 0; i < project.entryCount(); i++) {
+            ContentTable table;
+            if (project.entryTable(i, table)) {
+                CliMain::countStats(table, stats);
+            } else {
+                CliMain::countStats(project.entryContent(i), stats);
+            }
+        }
+
+        if (asJson) {
+            QJsonObject jStats;
+            jStats[QLatin1String("project")] = path;
+            jStats[QLatin1String("blocks")] = stats.blocks;
+            jStats[QLatin1String("headings")] = stats.headings;
+            jStats[QLatin1String("words")] = stats.words;
+            jStats[QLatin1String("chars")] = stats.chars;
+            m_out << QJsonDocument(jStats).toJson(QJsonDocument::Compact) << Qt::endl;
+        } else {
+            m_out << path << "\t" << stats.blocks << "\t" << stats.headings << "\t"
+                  << stats.words << "\t" << stats.chars << Qt::endl;
+        }
+    }
+
+    return result;
+}
+
+/**!
+ * @brief Export the text of a project as plain text, Markdown, HTML or PDF.
+ */
+int CliMain::runExport(const QStringList &arguments) {
+
+    QCommandLineParser parser;
+    CliMain::addExportOptions(parser);
+
+    if (!parser.parse(arguments) || parser.positionalArguments().size() != 2) {
+        m_err << (parser.errorText().isEmpty() ? parser.helpText() : parser.errorText()) << Qt::endl;
+        return 2;
+    }
+    if (parser.isSet("help")) {
+        m_out << parser.helpText();
+        return 0;
+    }
+
+    QString path = parser.positionalArguments().at(0);
+    QString output = parser.positionalArguments().at(1);
+
+    Exporter::Format format = Exporter::formatForPath(output);
+    if (parser.isSet("format") && !Exporter::parseFormat(parser.value("format"), format)) {
+        m_err << tr("Unknown export format: %1").arg(parser.value("format")) << Qt::endl;
+        return 2;
+    }
+
+    int jobs = 0;
+    if (parser.isSet("jobs")) {
+        bool isInt = false;
+        jobs = parser.value("jobs").toInt(&isInt);
+        if (!isInt || jobs < 1) {
+            m_err << tr("Invalid number of jobs: %1").arg(parser.value("jobs")) << Qt::endl;
+            return 2;
+        }
+    }
+
+    Project project;
+    if (!this->openProject(project, path)) {
+        return 1;
+    }
+
+    QFile file;
+    bool isOpen = false;
+    if (output == "-") {
+        isOpen = file.open(stdout, QIODevice::WriteOnly);
+    } else {
+        file.setFileName(output);
+        isOpen = file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+    }
+    if (!isOpen) {
+        m_err << tr("Could not open file for writing: %1").arg(output) << Qt::endl;
+        return 1;
+    }
+
+    Exporter exporter(&file, format);
+    if (jobs > 0) {
+        exporter.setThreadCount(jobs);
+    }
+    if (parser.isSet("cache") && !exporter.setCacheDirectory(parser.value("cache"))) {
+        m_err << tr("Could not create cache directory: %1").arg(parser.value("cache")) << Qt::endl;
+        return 1;
+    }
+    if (!exporter.exportProject(project)) {
+        m_err << tr("Could not write file: %1").arg(output) << Qt::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+/**!
+ * @brief Check that projects can be read and their content is well formed.
+ */
+int CliMain::runValidate(const QStringList &arguments) {
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(tr("Check that one or more projects can be read and are well formed."));
+    parser.addHelpOption();
+    parser.addPositionalArgument("projects", tr("The projects to check."), "<project>...");
+
+    if (!parser.parse(arguments) || parser.positionalArguments().isEmpty()) {
+        m_err << (parser.errorText().isEmpty() ? parser.helpText() : parser.errorText()) << Qt::endl;
+        return 2;
+    }
+    if (parser.isSet("help")) {
+        m_out << parser.helpText();
+        return 0;
+    }
+
+    int result = 0;
+    for (const QString &path : parser.positionalArguments()) {
+
+        Project project;
+        if (!this->openProject(project, path)) {
+            result = 1;
+            continue;
+        }
+
+        int problems = 0;
+        for (int i = 0; i < project.entryCount(); i++) {
+            QJsonArray jContent = project.entryContent(i);
+            for (qsizetype j = 0; j < jContent.size(); j++) {
+                QString problem;
+                if (!CliMain::validateBlock(jContent.at(j), problem)) {
+                    m_out << path << ": " << tr("Entry %1, block %2: %3").arg(i).arg(j).arg(problem) << Qt::endl;
+                    problems++;
+                }
+            }
+        }
+        if (project.hasError()) {
+            m_out << path << ": " << project.lastError() << Qt::endl;
+            problems++;
+        }
+
+        if (problems > 0) {
+            result = 1;
+        } else {
+            m_out << path << ": " << tr("OK") << Qt::endl;
+        }
+    }
+
+    return result;
+}
+
+/**
+ * Internal Functions
+ * ==================
+ */
+
+/**!
+ * @brief Open a project read-only, and report any errors.
+ *
+ * The commands only read the projects they open, so an edit journal that
+ * cannot be replayed is reported, and left for the editor to recover.
+ */
+bool CliMain::openProject(Project &project, const QString &path) {
+    if (!project.openProject(path, true)) {
+        m_err << path << ": " << (project.hasError() ? project.lastError() : tr("Could not open project")) << Qt::endl;
+        return false;
+    }
+    if (project.hasError()) {
+        m_err << path << ": " << project.lastError() << Qt::endl;
+    }
+    return true;
+}
+
+/**!
+ * @brief Add the options and arguments of the export command to a parser.
+ */
+void CliMain::addExportOptions(QCommandLineParser &parser) {
+    parser.setApplicationDescription(tr("Export the text of a project as plain text, Markdown, HTML or PDF."));
+    parser.addHelpOption();
+    parser.addOption(QCommandLineOption(
+        "format", tr("The export format: text, markdown, html or pdf. Default is from the output file extension."), "format"
+    ));
+    parser.addOption(QCommandLineOption(
+        "jobs", tr("The number of threads used to encode chapters. Default is one per core."), "count"
+    ));
+    parser.addOption(QCommandLineOption(
+        "cache", tr("A directory to cache the output of each chapter in, so a rebuild only encodes changed chapters."), "dir"
+    ));
+    parser.addPositionalArgument("project", tr("The project to export."));
+    parser.addPositionalArgument("output", tr("The file to write, or - for stdout."));
+}
+
+void CliMain::printUsage() {
+    m_err << tr("Usage: %1 <command> [options] [arguments]").arg(QCoreApplication::applicationFilePath()) << "\n\n"
+          << tr("Commands:") << "\n"
+          << "  convert   " << tr("Convert a project to another storage format") << "\n"
+          << "  stats     " << tr("Print text statistics of projects") << "\n"
+          << "  export    " << tr("Export the text of a project as text, Markdown, HTML or PDF") << "\n"
+          << "  validate  " << tr("Check that projects are well formed") << "\n\n"
+          << tr("Run a command with --help for its options.") << Qt::endl;
+}
+
+/**!
+ * @brief Add the text statistics of a list of content blocks.
+ *
+ * @param content the JSON content blocks.
+ * @param stats   the statistics to add to.
+ */
+void CliMain::countStats(const QJsonArray &content, TextStats &stats) {
+    for (const QJsonValue &jBlock : content) {
+        QJsonObject block = jBlock.toObject();
+        stats.blocks++;
+        if (FormatCodec::headingLevel(FormatCodec::decodeBlockValue(block.value(QLatin1String("u:fmt")))) > 0) {
+            stats.headings++;
+        }
+        CliMain::countText(CliMain::blockText(block), stats);
+    }
+}
+
+/**!
+ * @brief Add the text statistics of the blocks of a content table.
+ *
+ * The text is decoded block by block, so the counts match those of the
+ * same blocks as JSON.
+ *
+ * @param table the opened content table.
+ * @param stats the statistics to add to.
+ */
+void CliMain::countStats(const ContentTable &table, TextStats &stats) {
+    for (qsizetype i = 0; i < table.count(); i++) {
+        stats.blocks++;
+        if (FormatCodec::headingLevel(table.blockFormat(i)) > 0) {
+            stats.headings++;
+        }
+        CliMain::countText(QString::fromUtf8(table.blockText(i)), stats);
+    }
+}
+
+/**!
+ * @brief Add the word and character counts of a block's text.
+ *
+ * @param text  the plain text of the block.
+ * @param stats the statistics to add to.
+ */
+void CliMain::countText(QStringView text, TextStats &stats) {
+
+    stats.chars += text.size();
+
+    bool inWord = false;
+    for (QChar c : text) {
+        bool isSpace = c.isSpace();
+        if (!isSpace && !inWord) {
+            stats.words++;
+        }
+        inWord = !isSpace;
+    }
+}
+
+/**!
+ * @brief Get the plain text of a content block.
+ *
+ * @param block the JSON content block.
+ * @return the text of all fragments, without formats.
+ */
+QString CliMain::blockText(const QJsonObject &block) {
+
+    QString text;
+    auto appendFragment = [&text](const QString &fragment) {
+        quint32 charFmt = 0;
+        qsizetype pos = FormatCodec::splitFragment(fragment, charFmt);
+        if (pos >= 0 && (charFmt & FormatCodec::CharText)) {
+            text.append(QStringView(fragment).sliced(pos + 1));
+        }
+    };
+
+    QJsonValue jText = block.value(QLatin1String("u:txt"));
+    if (jText.isString()) {
+        appendFragment(jText.toString());
+    } else {
+        for (const QJsonValue &jFrag : block.value(QLatin1String("x:txt")).toArray()) {
+            appendFragment(jFrag.toString());
+        }
+    }
+
+    return text;
+}
+
+/**!
+ * @brief Check that a content block is well formed.
+ *
+ * @param block   the JSON content block.
+ * @param problem receives a description of the problem, if any.
+ * @return true if the block is well formed.
+ */
+bool CliMain::validateBlock(const QJsonValue &block, QString &problem) {
+
+    if (!block.isObject()) {
+        problem = tr("Block is not an object");
+        return false;
+    }
+
+    QJsonObject jBlock = block.toObject();
+    QJsonValue jFormat = jBlock.value(QLatin1String("u:fmt"));
+    if (!jFormat.isDouble() && !jFormat.isString()) {
+        problem = tr("Block has no format");
+        return false;
+    }
+
+    QJsonArray jFrags;
+    if (jBlock.value(QLatin1String("u:txt")).isString()) {
+        jFrags.append(jBlock.value(QLatin1String("u:txt")));
+    } else if (jBlock.value(QLatin1String("x:txt")).isArray()) {
+        jFrags = jBlock.value(QLatin1String("x:txt")).toArray();
+    } else {
+        problem = tr("Block has no text");
+        return false;
+    }
+
+    for (const QJsonValue &jFrag : jFrags) {
+        quint32 charFmt = 0;
+        if (!jFrag.isString() || FormatCodec::splitFragment(jFrag.toString(), charFmt) < 0) {
+            problem = tr("Text fragment has no format");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+} // namespace Collett
@@ -0,0 +1,83 @@
+/*
+** Collett – CLI Main Class
+** ========================
+**
+** This file is a part of Collett
+** Copyright 2020–2024, Veronica Berglyd Olsen
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef CLI_MAIN_H
+#define CLI_MAIN_H
+
+#include "collett.h"
+#include "contenttable.h"
+#include "project.h"
+
+#include <QCommandLineParser>
+#include <QJsonArray>
+#include <QStringList>
+#include <QStringView>
+#include <QTextStream>
+
+namespace Collett {
+
+class CliMain : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct TextStats {
+        qint64 blocks = 0;
+        qint64 headings = 0;
+        qint64 words = 0;
+        qint64 chars = 0;
+    };
+
+    explicit CliMain(QObject *parent=nullptr);
+    ~CliMain() {};
+
+    // Class Methods
+
+    int run(const QStringList &arguments);
+
+    // Static Methods
+
+    static bool isCommand(const QString &name);
+    static bool needsGui(const QStringList &arguments);
+
+private:
+    QTextStream m_out;
+    QTextStream m_err;
+
+    int runConvert(const QStringList &arguments);
+    int runStats(const QStringList &arguments);
+    int runExport(const QStringList &arguments);
+    int runValidate(const QStringList &arguments);
+
+    bool openProject(Project &project, const QString &path);
+    void printUsage();
+
+    static void addExportOptions(QCommandLineParser &parser);
+    static void countStats(const QJsonArray &content, TextStats &stats);
+    static void countStats(const ContentTable &table, TextStats &stats);
+    static void countText(QStringView text, TextStats &stats);
+    static QString blockText(const QJsonObject &block);
+    static bool validateBlock(const QJsonValue &block, QString &problem);
+
+};
+} // namespace Collett
+
+#endif // CLI_MAIN_H
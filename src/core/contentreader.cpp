@@ -0,0 +1,488 @@
+/*
+** Collett – Core Content Reader Class
+** ===================================
+**
+** This file is a part of Collett
+** Copyright 2020–2024, Veronica Berglyd Olsen
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "contentreader.h"
+
+#include <cstring>
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QDebug>
+#include <QLatin1String>
+#include <QStringView>
+
+namespace Collett {
+
+namespace {
+
+inline bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+inline bool isDelimiter(char c) {
+    return c == ',' || c == '}' || c == ']' || isSpace(c);
+}
+
+inline char16_t hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return 0;
+}
+
+} // namespace
+
+/**
+ * Streaming Content Reader
+ * ========================
+ * Reads the blocks of the x:content array of a JSON project file straight
+ * from the file bytes. Opening the reader scans the data once to find the
+ * byte offset of each block without decoding anything. Blocks can then be
+ * read in any order, and their strings are decoded into an arena that is
+ * reset for every block, so no JSON objects or heap strings are created.
+ */
+
+/**!
+ * @brief Create a reader over JSON data.
+ *
+ * Data mapped from a file is only valid while the file is open, so the file
+ * is kept with the reader and shared by its copies.
+ *
+ * @param data the JSON data.
+ * @param file the file the data is mapped from, if any.
+ */
+ContentReader::ContentReader(const QByteArray &data, QSharedPointer<QFile> file) :
+    m_file(file), m_data(data), m_decoder(QStringDecoder::Utf8),
+    m_arena(m_buffer.data(), m_buffer.size())
+{}
+
+/**!
+ * @brief Create a reader over the same data and block index.
+ *
+ * The copy has its own decoder and arena, and can read blocks on another
+ * thread than the original without opening the data again.
+ */
+ContentReader::ContentReader(const ContentReader &other) :
+    m_file(other.m_file), m_data(other.m_data), m_decoder(QStringDecoder::Utf8),
+    m_newline(other.m_newline), m_offsets(other.m_offsets),
+    m_arena(m_buffer.data(), m_buffer.size())
+{}
+
+/**
+ * Class Methods
+ * =============
+ */
+
+/**!
+ * @brief Find the content array and index its blocks.
+ *
+ * The data can be a full project file, or the u:document object alone.
+ *
+ * @return true if a complete content array was found.
+ */
+bool ContentReader::open() {
+
+    m_offsets.clear();
+
+    const char *data = m_data.constData();
+    qsizetype size = m_data.size();
+
+    qsizetype root = this->skipSpace(0);
+    qsizetype docPos = this->findMember(root, QLatin1String("u:document"));
+    qsizetype pos = this->findMember(docPos < 0 ? root : docPos, QLatin1String("x:content"));
+    if (pos < 0 || pos >= size || data[pos] != '[') {
+        qWarning() << "Could not find a content array in JSON data";
+        return false;
+    }
+
+    pos = this->skipSpace(pos + 1);
+    if (pos >= 0 && pos < size && data[pos] == ']') {
+        return true;
+    }
+
+    while (pos >= 0 && pos < size) {
+        m_offsets.append(pos);
+        pos = this->skipSpace(this->skipValue(pos));
+        if (pos < 0 || pos >= size) {
+            break;
+        } else if (data[pos] == ']') {
+            return true;
+        } else if (data[pos] != ',') {
+            break;
+        }
+        pos = this->skipSpace(pos + 1);
+    }
+
+    qWarning() << "Unexpected end of content array in JSON data";
+    m_offsets.clear();
+
+    return false;
+}
+
+/**!
+ * @brief Read a content block.
+ *
+ * The strings of the block are only valid until the next block is read.
+ *
+ * @param index the index of the block in the content array.
+ * @return true if the block was read.
+ */
+bool ContentReader::readBlock(qsizetype index) {
+
+    m_block.format = QStringView();
+    m_block.fragments.clear();
+    m_arena.release();
+
+    if (index < 0 || index >= m_offsets.size()) {
+        return false;
+    }
+
+    const char *data = m_data.constData();
+    qsizetype size = m_data.size();
+
+    qsizetype pos = m_offsets.at(index);
+    if (data[pos] != '{') {
+        qWarning() << "Unexpected content in JSON array. Expected JSON object.";
+        return false;
+    }
+
+    pos = this->skipSpace(pos + 1);
+    while (pos >= 0 && pos < size && data[pos] == '"') {
+
+        qsizetype keyEnd = this->skipString(pos);
+        qsizetype valuePos = this->skipSpace(keyEnd);
+        if (valuePos < 0 || valuePos >= size || data[valuePos] != ':') {
+            pos = -1;
+            break;
+        }
+        valuePos = this->skipSpace(valuePos + 1);
+
+        qsizetype valueEnd = -1;
+        QLatin1String key(data + pos + 1, keyEnd - pos - 2);
+        if (key == QLatin1String("u:fmt")) {
+            valueEnd = this->readString(valuePos, m_block.format);
+        } else if (key == QLatin1String("u:txt")) {
+            QStringView text;
+            valueEnd = this->readString(valuePos, text);
+            m_block.fragments.append(text);
+        } else if (key == QLatin1String("x:txt") && valuePos < size && data[valuePos] == '[') {
+            valueEnd = this->skipSpace(valuePos + 1);
+            while (valueEnd >= 0 && valueEnd < size && data[valueEnd] == '"') {
+                QStringView text;
+                valueEnd = this->skipSpace(this->readString(valueEnd, text));
+                m_block.fragments.append(text);
+                if (valueEnd >= 0 && valueEnd < size && data[valueEnd] == ',') {
+                    valueEnd = this->skipSpace(valueEnd + 1);
+                }
+            }
+            valueEnd = valueEnd >= 0 && valueEnd < size && data[valueEnd] == ']' ? valueEnd + 1 : -1;
+        } else {
+            valueEnd = this->skipValue(valuePos);
+        }
+
+        pos = this->skipSpace(valueEnd);
+        if (pos < 0 || pos >= size || data[pos] != ',') {
+            break;
+        }
+        pos = this->skipSpace(pos + 1);
+    }
+
+    if (pos < 0 || pos >= size || data[pos] != '}') {
+        qWarning() << "Could not parse content block" << index;
+        return false;
+    }
+
+    return true;
+}
+
+/**!
+ * @brief Read only the format of a content block.
+ *
+ * The format is only valid until the next block is read.
+ *
+ * @param index  the index of the block in the content array.
+ * @param format the view to receive the format.
+ * @return true if the block has a format.
+ */
+bool ContentReader::readFormat(qsizetype index, QStringView &format) {
+
+    format = QStringView();
+    m_arena.release();
+
+    if (index < 0 || index >= m_offsets.size()) {
+        return false;
+    }
+
+    qsizetype pos = this->findMember(m_offsets.at(index), QLatin1String("u:fmt"));
+    return pos >= 0 && this->readString(pos, format) >= 0;
+}
+
+/**
+ * Class Setters
+ * =============
+ */
+
+/**!
+ * @brief Set the character that \n escapes are decoded to.
+ *
+ * The editor uses QChar::LineSeparator for line breaks within a block.
+ */
+void ContentReader::setNewline(QChar newline) {
+    m_newline = newline.unicode();
+}
+
+/**
+ * Class Getters
+ * =============
+ */
+
+qsizetype ContentReader::count() const {
+    return m_offsets.size();
+}
+
+const ContentBlock &ContentReader::block() const {
+    return m_block;
+}
+
+/**!
+ * @brief Get the raw bytes of a range of blocks.
+ *
+ * @param from the index of the first block.
+ * @param to   the index after the last block.
+ * @return the bytes from the start of the first block to the end of the
+ *         last, or an empty view if the range is not valid.
+ */
+QByteArrayView ContentReader::blockData(qsizetype from, qsizetype to) const {
+    if (from < 0 || to > m_offsets.size() || from >= to) {
+        return QByteArrayView();
+    }
+    qsizetype start = m_offsets.at(from);
+    qsizetype end = to < m_offsets.size() ? m_offsets.at(to) : this->skipValue(m_offsets.at(to - 1));
+    if (end < start) {
+        return QByteArrayView();
+    }
+    return QByteArrayView(m_data.constData() + start, end - start);
+}
+
+/**
+ * Internal Functions
+ * ==================
+ * The scanning functions take the position of a token and return the
+ * position after it, or -1 if the data is malformed. A position of -1 is
+ * passed through, so calls can be chained and checked once.
+ */
+
+qsizetype ContentReader::skipSpace(qsizetype pos) const {
+    if (pos < 0) {
+        return -1;
+    }
+    const char *data = m_data.constData();
+    qsizetype size = m_data.size();
+    while (pos < size && isSpace(data[pos])) {
+        ++pos;
+    }
+    return pos;
+}
+
+qsizetype ContentReader::skipString(qsizetype pos) const {
+    const char *data = m_data.constData();
+    qsizetype size = m_data.size();
+    if (pos < 0 || pos >= size || data[pos] != '"') {
+        return -1;
+    }
+    for (qsizetype i = pos + 1; i < size; ++i) {
+        if (data[i] == '\\') {
+            ++i;
+        } else if (data[i] == '"') {
+            return i + 1;
+        }
+    }
+    return -1;
+}
+
+qsizetype ContentReader::skipValue(qsizetype pos) const {
+
+    const char *data = m_data.constData();
+    qsizetype size = m_data.size();
+    if (pos < 0 || pos >= size) {
+        return -1;
+    }
+
+    char c = data[pos];
+    if (c == '"') {
+        return this->skipString(pos);
+    }
+
+    if (c == '{' || c == '[') {
+        int depth = 0;
+        for (qsizetype i = pos; i < size; ++i) {
+            switch (data[i]) {
+            case '"':
+                i = this->skipString(i);
+                if (i < 0) {
+                    return -1;
+                }
+                --i;
+                break;
+            case '{':
+            case '[':
+                ++depth;
+                break;
+            case '}':
+            case ']':
+                if (--depth == 0) {
+                    return i + 1;
+                }
+                break;
+            default:
+                break;
+            }
+        }
+        return -1;
+    }
+
+    // Numbers, booleans and null
+    qsizetype i = pos;
+    while (i < size && !isDelimiter(data[i])) {
+        ++i;
+    }
+    return i > pos ? i : -1;
+}
+
+/**!
+ * @brief Find a member of an object by key.
+ *
+ * @param pos the position of the opening brace of the object.
+ * @param key the member key.
+ * @return the position of the member value, or -1 if not found.
+ */
+qsizetype ContentReader::findMember(qsizetype pos, QLatin1String key) const {
+
+    const char *data = m_data.constData();
+    qsizetype size = m_data.size();
+    if (pos < 0 || pos >= size || data[pos] != '{') {
+        return -1;
+    }
+
+    pos = this->skipSpace(pos + 1);
+    while (pos >= 0 && pos < size && data[pos] == '"') {
+        qsizetype keyEnd = this->skipString(pos);
+        qsizetype valuePos = this->skipSpace(keyEnd);
+        if (valuePos < 0 || valuePos >= size || data[valuePos] != ':') {
+            return -1;
+        }
+        valuePos = this->skipSpace(valuePos + 1);
+        if (QLatin1String(data + pos + 1, keyEnd - pos - 2) == key) {
+            return valuePos;
+        }
+        pos = this->skipSpace(this->skipValue(valuePos));
+        if (pos < 0 || pos >= size || data[pos] != ',') {
+            return -1;
+        }
+        pos = this->skipSpace(pos + 1);
+    }
+
+    return -1;
+}
+
+/**!
+ * @brief Decode a JSON string into the block arena.
+ *
+ * A number is returned as its digits, since format version 2 stores block
+ * formats as integers. Any other value that is not a string is skipped and
+ * gives an empty string. The decoded string is never longer than the raw
+ * bytes, so the buffer is sized from them.
+ *
+ * @param pos  the position of the opening quote.
+ * @param text the view to receive the decoded string.
+ * @return the position after the closing quote, or -1 on error.
+ */
+qsizetype ContentReader::readString(qsizetype pos, QStringView &text) {
+
+    text = QStringView();
+
+    const char *data = m_data.constData();
+    if (pos >= 0 && pos < m_data.size() && data[pos] >= '0' && data[pos] <= '9') {
+        qsizetype end = this->skipValue(pos);
+        if (end > pos) {
+            QChar *out = static_cast<QChar *>(m_arena.allocate((end - pos) * sizeof(QChar), alignof(QChar)));
+            for (qsizetype i = pos; i < end; ++i) {
+                out[i - pos] = QLatin1Char(data[i]);
+            }
+            text = QStringView(out, end - pos);
+        }
+        return end;
+    }
+
+    qsizetype end = this->skipString(pos);
+    if (end < 0) {
+        return this->skipValue(pos);
+    }
+
+    const char *raw = data + pos + 1;
+    qsizetype rawLen = end - pos - 2;
+    if (rawLen == 0) {
+        return end;
+    }
+
+    QChar *out = static_cast<QChar *>(m_arena.allocate(rawLen * sizeof(QChar), alignof(QChar)));
+    QChar *cur = out;
+
+    qsizetype i = 0;
+    while (i < rawLen) {
+        const char *esc = static_cast<const char *>(std::memchr(raw + i, '\\', rawLen - i));
+        qsizetype segEnd = esc ? esc - raw : rawLen;
+        if (segEnd > i) {
+            cur = m_decoder.appendToBuffer(cur, QByteArrayView(raw + i, segEnd - i));
+        }
+        if (!esc) {
+            break;
+        }
+
+        // The scan in skipString guarantees a character after the backslash
+        i = segEnd + 1;
+        char e = raw[i++];
+        switch (e) {
+        case 'n': *cur++ = QChar(m_newline); break;
+        case 't': *cur++ = QChar(u'\t'); break;
+        case 'r': *cur++ = QChar(u'\r'); break;
+        case 'b': *cur++ = QChar(u'\b'); break;
+        case 'f': *cur++ = QChar(u'\f'); break;
+        case 'u': {
+            char16_t code = 0;
+            for (int k = 0; k < 4 && i < rawLen; ++k, ++i) {
+                code = code*16 + hexValue(raw[i]);
+            }
+            *cur++ = QChar(code);
+            break;
+        }
+        default:
+            *cur++ = QChar(char16_t(uchar(e)));
+            break;
+        }
+    }
+
+    text = QStringView(out, cur - out);
+
+    return end;
+}
+
+} // namespace Collett
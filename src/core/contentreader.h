@@ -0,0 +1,99 @@
+/*
+** Collett – Core Content Reader Class
+** ===================================
+**
+** This file is a part of Collett
+** Copyright 2020–2024, Veronica Berglyd Olsen
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef COLLETT_CONTENT_READER_H
+#define COLLETT_CONTENT_READER_H
+
+#include "collett.h"
+
+#include <array>
+#include <cstddef>
+#include <memory_resource>
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QFile>
+#include <QList>
+#include <QSharedPointer>
+#include <QStringDecoder>
+#include <QStringView>
+#include <QVarLengthArray>
+
+#define COL_CONTENT_ARENA_SIZE 65536
+
+namespace Collett {
+
+struct ContentBlock
+{
+    QStringView format;
+    QVarLengthArray<QStringView, 8> fragments;
+};
+
+class ContentReader
+{
+
+public:
+    explicit ContentReader(const QByteArray &data, QSharedPointer<QFile> file = nullptr);
+    ContentReader(const ContentReader &other);
+    ~ContentReader() {};
+
+    ContentReader &operator=(const ContentReader &) = delete;
+
+    // Class Methods
+
+    bool open();
+    bool readBlock(qsizetype index);
+    bool readFormat(qsizetype index, QStringView &format);
+
+    // Class Setters
+
+    void setNewline(QChar newline);
+
+    // Class Getters
+
+    qsizetype count() const;
+    const ContentBlock &block() const;
+    QByteArrayView blockData(qsizetype from, qsizetype to) const;
+
+private:
+    QSharedPointer<QFile> m_file;
+    QByteArray     m_data;
+    QStringDecoder m_decoder;
+    char16_t       m_newline = u'\n';
+
+    QList<qsizetype> m_offsets;
+    ContentBlock     m_block;
+
+    // Block Arena
+
+    std::array<std::byte, COL_CONTENT_ARENA_SIZE> m_buffer;
+    std::pmr::monotonic_buffer_resource m_arena;
+
+    qsizetype skipSpace(qsizetype pos) const;
+    qsizetype skipString(qsizetype pos) const;
+    qsizetype skipValue(qsizetype pos) const;
+    qsizetype findMember(qsizetype pos, QLatin1String key) const;
+    qsizetype readString(qsizetype pos, QStringView &text);
+
+};
+} // namespace Collett
+
+#endif // COLLETT_CONTENT_READER_H
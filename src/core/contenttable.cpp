@@ -0,0 +1,366 @@
+/*
+** Collett – Core Content Table Class
+** ==================================
+**
+** This file is a part of Collett
+** Copyright 2020–2024, Veronica Berglyd Olsen
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "contenttable.h"
+#include "formatcodec.h"
+#include "storage.h"
+
+#include <limits>
+
+#include <QByteArray>
+#include <QDebug>
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QList>
+#include <QtEndian>
+
+#define COL_CTAB_MAGIC   "CTAB"
+#define COL_CTAB_VERSION 1
+#define COL_CTAB_HEADER  32
+
+namespace Collett {
+
+/**
+ * Columnar Content Table
+ * ======================
+ * A binary layout of document content that can be memory mapped and read
+ * in place. All text is stored in a single UTF-8 blob, and the structure is
+ * held in columns of little endian 32 bit integers:
+ *
+ *   Offset  Size            Content
+ *   0       4               Magic bytes "CTAB"
+ *   4       4               Format version
+ *   8       4               Block count (B)
+ *   12      4               Fragment run count (R)
+ *   16      8               Text blob size in bytes (T)
+ *   24      8               Reserved
+ *   32      4*(B+1)         Block text offsets into the blob
+ *           4*B             Block format bitmasks
+ *           4*(B+1)         Index of the first run of each block
+ *           4*R             Run text offsets into the blob
+ *           4*R             Run char format bitmasks
+ *           T               Text blob
+ *
+ * The last entry of the block offsets and run index columns hold the blob
+ * size and run count, so block i spans [offset(i), offset(i+1)). Format
+ * bitmasks are those of FormatCodec. Line breaks are stored as \n.
+ */
+
+ContentTable::~ContentTable() {
+    this->close();
+}
+
+/**
+ * Class Methods
+ * =============
+ */
+
+/**!
+ * @brief Open and memory map a content table file.
+ *
+ * @param filePath the path of the table file.
+ * @return true if the file holds a valid table.
+ */
+bool ContentTable::open(const QString &filePath) {
+
+    this->close();
+
+    m_file.setFileName(filePath);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Could not open file:" << filePath;
+        return false;
+    }
+
+    m_data = Storage::mapFile(m_file);
+    if (!this->parse()) {
+        qWarning() << "Invalid content table:" << filePath;
+        this->close();
+        return false;
+    }
+
+    return true;
+}
+
+/**!
+ * @brief Use a content table held in memory.
+ *
+ * @param data the table data.
+ * @return true if the data holds a valid table.
+ */
+bool ContentTable::setData(const QByteArray &data) {
+
+    this->close();
+
+    m_data = data;
+    if (!this->parse()) {
+        this->close();
+        return false;
+    }
+
+    return true;
+}
+
+void ContentTable::close() {
+    m_isValid = false;
+    m_data.clear();
+    if (m_file.isOpen()) {
+        m_file.close();
+    }
+}
+
+/**
+ * Class Getters
+ * =============
+ */
+
+bool ContentTable::isValid() const {
+    return m_isValid;
+}
+
+qsizetype ContentTable::count() const {
+    return m_isValid ? m_blockCount : 0;
+}
+
+quint32 ContentTable::blockFormat(qsizetype block) const {
+    if (!m_isValid || block < 0 || block >= qsizetype(m_blockCount)) {
+        return 0;
+    }
+    return ContentTable::column(m_blockFormats, block);
+}
+
+/**!
+ * @brief The text of a block as UTF-8, across all its runs.
+ */
+QByteArrayView ContentTable::blockText(qsizetype block) const {
+    if (!m_isValid || block < 0 || block >= qsizetype(m_blockCount)) {
+        return QByteArrayView();
+    }
+    quint32 start = ContentTable::column(m_blockOffsets, block);
+    quint32 end = ContentTable::column(m_blockOffsets, block + 1);
+    return QByteArrayView(m_text + start, end - start);
+}
+
+qsizetype ContentTable::runCount(qsizetype block) const {
+    if (!m_isValid || block < 0 || block >= qsizetype(m_blockCount)) {
+        return 0;
+    }
+    return ContentTable::column(m_blockRuns, block + 1) - ContentTable::column(m_blockRuns, block);
+}
+
+/**!
+ * @brief The text of a fragment run of a block as UTF-8.
+ *
+ * @param block      the block index.
+ * @param run        the run index within the block.
+ * @param charFormat receives the char format bitmask of the run.
+ * @return the run text.
+ */
+QByteArrayView ContentTable::runText(qsizetype block, qsizetype run, quint32 &charFormat) const {
+
+    charFormat = 0;
+    if (run < 0 || run >= this->runCount(block)) {
+        return QByteArrayView();
+    }
+
+    quint32 index = ContentTable::column(m_blockRuns, block) + run;
+    quint32 start = ContentTable::column(m_runStarts, index);
+    quint32 end = index + 1 < ContentTable::column(m_blockRuns, block + 1)
+        ? ContentTable::column(m_runStarts, index + 1)
+        : ContentTable::column(m_blockOffsets, block + 1);
+    charFormat = ContentTable::column(m_runFormats, index);
+
+    return QByteArrayView(m_text + start, end - start);
+}
+
+/**!
+ * @brief The full text blob as UTF-8.
+ */
+QByteArrayView ContentTable::text() const {
+    return m_isValid ? QByteArrayView(m_text, m_textSize) : QByteArrayView();
+}
+
+/**!
+ * @brief Count the words of all blocks.
+ *
+ * Words are runs of characters between ASCII whitespace, counted straight
+ * from the text blob. Blocks end words as well.
+ */
+qsizetype ContentTable::wordCount() const {
+
+    qsizetype words = 0;
+    for (qsizetype i = 0; i < this->count(); ++i) {
+        bool inWord = false;
+        for (char c : this->blockText(i)) {
+            bool isSpace = c == ' ' || c == '\t' || c == '\n' || c == '\r';
+            if (!isSpace && !inWord) {
+                ++words;
+            }
+            inWord = !isSpace;
+        }
+    }
+
+    return words;
+}
+
+/**
+ * Static Methods
+ * ==============
+ */
+
+/**!
+ * @brief Encode JSON content blocks as a content table.
+ *
+ * @param content the JSON content array.
+ * @return the table data, or an empty array if the text is too large.
+ */
+QByteArray ContentTable::encode(const QJsonArray &content) {
+
+    QByteArray text;
+    QList<quint32> blockOffsets, blockFormats, blockRuns, runStarts, runFormats;
+
+    for (const QJsonValue &jBlockValue : content) {
+
+        QJsonObject jBlock = jBlockValue.toObject();
+        blockOffsets.append(text.size());
+        blockRuns.append(runStarts.size());
+        blockFormats.append(FormatCodec::decodeBlockValue(jBlock.value(QLatin1String("u:fmt"))));
+
+        QJsonArray jFrags;
+        if (jBlock.value(QLatin1String("u:txt")).isString()) {
+            jFrags.append(jBlock.value(QLatin1String("u:txt")));
+        } else {
+            jFrags = jBlock.value(QLatin1String("x:txt")).toArray();
+        }
+
+        for (const QJsonValue &jFrag : jFrags) {
+            QString fragment = jFrag.toString();
+            quint32 charFmt = 0;
+            qsizetype fmtTagPos = FormatCodec::splitFragment(fragment, charFmt);
+            runStarts.append(text.size());
+            runFormats.append(charFmt);
+            text.append(QStringView(fragment).sliced(fmtTagPos + 1).toUtf8());
+        }
+
+        if (quint64(text.size()) > std::numeric_limits<quint32>::max()) {
+            qWarning() << "Content too large for a content table";
+            return QByteArray();
+        }
+    }
+    blockOffsets.append(text.size());
+    blockRuns.append(runStarts.size());
+
+    QByteArray data;
+    data.reserve(COL_CTAB_HEADER + 4*(blockOffsets.size() + blockFormats.size() + blockRuns.size())
+        + 8*runStarts.size() + text.size());
+
+    auto appendValue = [&data](auto value) {
+        value = qToLittleEndian(value);
+        data.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    };
+
+    data.append(COL_CTAB_MAGIC, 4);
+    appendValue(quint32(COL_CTAB_VERSION));
+    appendValue(quint32(blockFormats.size()));
+    appendValue(quint32(runStarts.size()));
+    appendValue(quint64(text.size()));
+    appendValue(quint64(0));
+
+    for (const QList<quint32> *col : {&blockOffsets, &blockFormats, &blockRuns, &runStarts, &runFormats}) {
+        for (quint32 value : *col) {
+            appendValue(value);
+        }
+    }
+    data.append(text);
+
+    return data;
+}
+
+/**
+ * Internal Functions
+ * ==================
+ */
+
+/**!
+ * @brief Check the table header and columns, and set up the pointers.
+ */
+bool ContentTable::parse() {
+
+    m_isValid = false;
+    if (m_data.size() < COL_CTAB_HEADER || !m_data.startsWith(COL_CTAB_MAGIC)) {
+        return false;
+    }
+
+    const uchar *data = reinterpret_cast<const uchar *>(m_data.constData());
+    if (qFromLittleEndian<quint32>(data + 4) != COL_CTAB_VERSION) {
+        return false;
+    }
+
+    m_blockCount = qFromLittleEndian<quint32>(data + 8);
+    m_runCount = qFromLittleEndian<quint32>(data + 12);
+    m_textSize = qFromLittleEndian<quint64>(data + 16);
+
+    quint64 columns = 4*(3*quint64(m_blockCount) + 2) + 8*quint64(m_runCount);
+    if (quint64(m_data.size()) != COL_CTAB_HEADER + columns + m_textSize) {
+        return false;
+    }
+
+    m_blockOffsets = data + COL_CTAB_HEADER;
+    m_blockFormats = m_blockOffsets + 4*(m_blockCount + 1);
+    m_blockRuns = m_blockFormats + 4*m_blockCount;
+    m_runStarts = m_blockRuns + 4*(m_blockCount + 1);
+    m_runFormats = m_runStarts + 4*m_runCount;
+    m_text = reinterpret_cast<const char *>(m_runFormats + 4*m_runCount);
+
+    // Offsets must be in order and inside the blob, so that the getters
+    // can slice the blob without further checks
+    if (ContentTable::column(m_blockOffsets, 0) != 0 || ContentTable::column(m_blockRuns, 0) != 0
+        || ContentTable::column(m_blockOffsets, m_blockCount) != m_textSize
+        || ContentTable::column(m_blockRuns, m_blockCount) != m_runCount) {
+        return false;
+    }
+    for (quint32 i = 0; i < m_blockCount; ++i) {
+        quint32 runFirst = ContentTable::column(m_blockRuns, i);
+        quint32 runEnd = ContentTable::column(m_blockRuns, i + 1);
+        quint32 blockStart = ContentTable::column(m_blockOffsets, i);
+        quint32 blockEnd = ContentTable::column(m_blockOffsets, i + 1);
+        if (runEnd < runFirst || blockEnd < blockStart) {
+            return false;
+        }
+        quint32 prev = blockStart;
+        for (quint32 r = runFirst; r < runEnd; ++r) {
+            quint32 runStart = ContentTable::column(m_runStarts, r);
+            if (runStart < prev || runStart > blockEnd) {
+                return false;
+            }
+            prev = runStart;
+        }
+    }
+
+    m_isValid = true;
+
+    return true;
+}
+
+quint32 ContentTable::column(const uchar *data, qsizetype index) {
+    return qFromLittleEndian<quint32>(data + 4*index);
+}
+
+} // namespace Collett
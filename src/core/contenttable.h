@@ -0,0 +1,85 @@
+/*
+** Collett – Core Content Table Class
+** ==================================
+**
+** This file is a part of Collett
+** Copyright 2020–2024, Veronica Berglyd Olsen
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef COLLETT_CONTENT_TABLE_H
+#define COLLETT_CONTENT_TABLE_H
+
+#include "collett.h"
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QFile>
+#include <QJsonArray>
+#include <QString>
+
+namespace Collett {
+
+class ContentTable
+{
+
+public:
+    ContentTable() {};
+    ~ContentTable();
+
+    // Class Methods
+
+    bool open(const QString &filePath);
+    bool setData(const QByteArray &data);
+    void close();
+
+    // Class Getters
+
+    bool isValid() const;
+    qsizetype count() const;
+    quint32 blockFormat(qsizetype block) const;
+    QByteArrayView blockText(qsizetype block) const;
+    qsizetype runCount(qsizetype block) const;
+    QByteArrayView runText(qsizetype block, qsizetype run, quint32 &charFormat) const;
+    QByteArrayView text() const;
+    qsizetype wordCount() const;
+
+    // Static Methods
+
+    static QByteArray encode(const QJsonArray &content);
+
+private:
+    QFile      m_file;
+    QByteArray m_data;
+    bool       m_isValid = false;
+
+    quint32 m_blockCount = 0;
+    quint32 m_runCount = 0;
+    quint64 m_textSize = 0;
+
+    const uchar *m_blockOffsets = nullptr;
+    const uchar *m_blockFormats = nullptr;
+    const uchar *m_blockRuns = nullptr;
+    const uchar *m_runStarts = nullptr;
+    const uchar *m_runFormats = nullptr;
+    const char  *m_text = nullptr;
+
+    bool parse();
+    static quint32 column(const uchar *data, qsizetype index);
+
+};
+} // namespace Collett
+
+#endif // COLLETT_CONTENT_TABLE_H
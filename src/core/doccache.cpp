@@ -0,0 +1,158 @@
+/*
+** Collett – Core Document Cache Class
+** ===================================
+**
+** This file is a part of Collett
+** Copyright 2020–2024, Veronica Berglyd Olsen
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "doccache.h"
+
+#define COL_CACHE_BLOCK_OVERHEAD 64
+
+#include <algorithm>
+
+#include <QCache>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QString>
+
+namespace Collett {
+
+/**
+ * Document Cache
+ * ==============
+ * Keeps the parsed content of recently used document entries, keyed by the
+ * entry handle. The cost of each entry is its estimated size in memory, and
+ * the least recently used entries are evicted when the total exceeds the
+ * budget. Entry handles are content hashes, so a cached entry never goes
+ * stale.
+ */
+
+DocumentCache::DocumentCache(qsizetype budget) : m_cache(budget) {}
+
+DocumentCache::~DocumentCache() {
+    qDebug() << "Document cache:" << m_hits << "hits," << m_misses << "misses,"
+             << m_evictions << "evictions";
+}
+
+/**
+ * Class Methods
+ * =============
+ */
+
+/**!
+ * @brief Look up an entry and mark it as recently used.
+ *
+ * @param handle  the entry handle.
+ * @param content receives the cached content, if found.
+ * @return true if the entry was in the cache.
+ */
+bool DocumentCache::lookup(const QString &handle, QJsonArray &content) {
+    QJsonArray *cached = m_cache.object(handle);
+    if (cached == nullptr) {
+        m_misses++;
+        return false;
+    }
+    content = *cached;
+    m_hits++;
+    return true;
+}
+
+/**!
+ * @brief Add an entry, evicting the least recently used ones if needed.
+ *
+ * Entries larger than the whole budget are not cached.
+ *
+ * @param handle  the entry handle.
+ * @param content the entry content.
+ */
+void DocumentCache::insert(const QString &handle, const QJsonArray &content) {
+    qsizetype before = m_cache.count() + (m_cache.contains(handle) ? 0 : 1);
+    if (m_cache.insert(handle, new QJsonArray(content), DocumentCache::estimateSize(content))) {
+        m_evictions += before - m_cache.count();
+    }
+}
+
+void DocumentCache::clear() {
+    m_cache.clear();
+}
+
+/**
+ * Class Setters
+ * =============
+ */
+
+void DocumentCache::setBudget(qsizetype budget) {
+    qsizetype before = m_cache.count();
+    m_cache.setMaxCost(budget);
+    m_evictions += before - m_cache.count();
+}
+
+/**
+ * Class Getters
+ * =============
+ */
+
+qsizetype DocumentCache::budget() const {
+    return m_cache.maxCost();
+}
+
+qsizetype DocumentCache::usage() const {
+    return m_cache.totalCost();
+}
+
+qint64 DocumentCache::hits() const {
+    return m_hits;
+}
+
+qint64 DocumentCache::misses() const {
+    return m_misses;
+}
+
+qint64 DocumentCache::evictions() const {
+    return m_evictions;
+}
+
+/**
+ * Static Methods
+ * ==============
+ */
+
+/**!
+ * @brief Estimate the memory used by the content of an entry.
+ *
+ * The estimate counts the UTF-16 text of each block plus a fixed overhead
+ * per block for the JSON containers.
+ *
+ * @param content the entry content.
+ * @return the estimated size in bytes.
+ */
+qsizetype DocumentCache::estimateSize(const QJsonArray &content) {
+    qsizetype size = 0;
+    for (const QJsonValue &jBlock : content) {
+        QJsonObject block = jBlock.toObject();
+        size += COL_CACHE_BLOCK_OVERHEAD;
+        size += 2*block.value(QLatin1String("u:txt")).toString().size();
+        for (const QJsonValue &jFrag : block.value(QLatin1String("x:txt")).toArray()) {
+            size += 2*jFrag.toString().size() + COL_CACHE_BLOCK_OVERHEAD/4;
+        }
+    }
+    return std::max<qsizetype>(size, 1);
+}
+
+} // namespace Collett
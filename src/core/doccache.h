@@ -0,0 +1,72 @@
+/*
+** Collett – Core Document Cache Class
+** ===================================
+**
+** This file is a part of Collett
+** Copyright 2020–2024, Veronica Berglyd Olsen
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef COLLETT_DOC_CACHE_H
+#define COLLETT_DOC_CACHE_H
+
+#include "collett.h"
+
+#include <QCache>
+#include <QJsonArray>
+#include <QString>
+
+namespace Collett {
+
+class DocumentCache
+{
+
+public:
+    explicit DocumentCache(qsizetype budget);
+    ~DocumentCache();
+
+    // Class Methods
+
+    bool lookup(const QString &handle, QJsonArray &content);
+    void insert(const QString &handle, const QJsonArray &content);
+    void clear();
+
+    // Class Setters
+
+    void setBudget(qsizetype budget);
+
+    // Class Getters
+
+    qsizetype budget() const;
+    qsizetype usage() const;
+    qint64 hits() const;
+    qint64 misses() const;
+    qint64 evictions() const;
+
+    // Static Methods
+
+    static qsizetype estimateSize(const QJsonArray &content);
+
+private:
+    QCache<QString, QJsonArray> m_cache;
+
+    qint64 m_hits = 0;
+    qint64 m_misses = 0;
+    qint64 m_evictions = 0;
+
+};
+} // namespace Collett
+
+#endif // COLLETT_DOC_CACHE_H
@@ -0,0 +1,1113 @@
+/*
+** Collett – Core Exporter Class
+** =============================
+**
+** This file is a part of Collett
+** Copyright 2020–2024, Veronica Berglyd Olsen
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "exporter.h"
+#include "contentreader.h"
+#include "contenttable.h"
+#include "docbuilder.h"
+#include "formatcodec.h"
+#include "settings.h"
+
+#define COL_EXPORT_BUFFER_SIZE 65536
+#define COL_EXPORT_BATCH_SIZE 4
+#define COL_EXPORT_CACHE_MAGIC "collett-export-1"
+#define COL_EXPORT_PAGES_MAGIC "collett-pages-1"
+
+#include <memory>
+
+#include <QAbstractTextDocumentLayout>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QFont>
+#include <QImage>
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QMarginsF>
+#include <QPageLayout>
+#include <QPageSize>
+#include <QRectF>
+#include <QSaveFile>
+#include <QScopedPointer>
+#include <QStringList>
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QTextLayout>
+#include <QThread>
+#include <QtConcurrent>
+#include <QtEndian>
+
+namespace Collett {
+
+/**
+ * Streaming Exporter
+ * ==================
+ * Writes the text of a project as plain text, Markdown or HTML straight
+ * from the stored blocks and fragments, without building a text document.
+ * The output is encoded into a small buffer that is written to the device
+ * whenever it fills up.
+ *
+ * Archive projects are exported one entry at a time. Flat projects that
+ * have not been loaded are streamed from the file data with a content
+ * reader, so the content is never held as JSON objects.
+ *
+ * The text is split into chapters at level 1 and 2 headings, and batches
+ * of chapters are encoded concurrently on a thread pool. The encoding of a
+ * chapter only depends on its own blocks and its position, so the chapters
+ * are written in order and the output is the same for any thread count.
+ *
+ * If a cache directory is set, the encoded output of each chapter is saved
+ * there under a hash of its source blocks. A rebuild only encodes the
+ * chapters whose hash is not in the cache, and cache entries that were not
+ * used by the last build are removed.
+ *
+ * PDF output is laid out with the editor text styles. Each chapter is
+ * built into its own text document, paginated and recorded page by page on
+ * the thread pool, then painted in order. Chapters start on a new page, so
+ * the pages of a chapter only depend on its blocks, the text styles and the
+ * page size, and are cached under a hash of those.
+ */
+
+Exporter::Exporter(QIODevice *device, Format format) :
+    m_device(device), m_format(format), m_encoder(QStringEncoder::Utf8)
+{
+    m_buffer.reserve(COL_EXPORT_BUFFER_SIZE + 4096);
+    m_pool.setMaxThreadCount(QThread::idealThreadCount());
+}
+
+Exporter::~Exporter() {
+    this->flush();
+}
+
+/**
+ * Class Methods
+ * =============
+ */
+
+/**!
+ * @brief Export the full text of a project.
+ *
+ * @param project the project to export.
+ * @return true if all data was written to the device.
+ */
+bool Exporter::exportProject(Project &project) {
+
+    m_blocks = 0;
+    m_cached = 0;
+    m_cacheUsed.clear();
+    this->writeHeader(project.projectName());
+
+    std::unique_ptr<ContentReader> reader = project.contentReader();
+
+    QList<Chapter> chapters;
+    if (reader) {
+        reader->setNewline('\n');
+        this->splitChapters(chapters, *reader);
+        this->writeChapters(chapters, reader.get());
+    } else {
+        // Archive entries with a content table are read from the mapped
+        // table, without parsing their JSON
+        int batchSize = COL_EXPORT_BATCH_SIZE * m_pool.maxThreadCount();
+        for (int i = 0; i < project.entryCount(); i++) {
+            QSharedPointer<ContentTable> table(new ContentTable);
+            if (project.entryTable(i, *table)) {
+                this->splitChapters(chapters, table);
+            } else {
+                this->splitChapters(chapters, project.entryContent(i));
+            }
+            if (chapters.size() >= batchSize) {
+                this->writeChapters(chapters, nullptr);
+            }
+        }
+        this->writeChapters(chapters, nullptr);
+    }
+
+    this->writeFooter();
+    this->pruneCache();
+
+    return this->flush();
+}
+
+/**!
+ * @brief Write the buffered data to the device.
+ *
+ * @return true if no write has failed so far.
+ */
+bool Exporter::flush() {
+    if (m_device && !m_buffer.isEmpty() && !m_failed) {
+        if (m_device->write(m_buffer) != m_buffer.size()) {
+            m_failed = true;
+        }
+        m_buffer.clear();
+    }
+    return !m_failed;
+}
+
+/**
+ * Class Setters
+ * =============
+ */
+
+/**!
+ * @brief Set the number of threads used to encode chapters.
+ *
+ * @param count the thread count, 1 to encode on the calling thread.
+ */
+void Exporter::setThreadCount(int count) {
+    m_pool.setMaxThreadCount(qMax(1, count));
+}
+
+/**!
+ * @brief Set the directory used to cache the output of chapters.
+ *
+ * The directory should only be used for builds of one project, as entries
+ * of other builds in the same format are removed.
+ *
+ * @param path the cache directory, which is created if needed.
+ * @return false if the directory could not be created.
+ */
+bool Exporter::setCacheDirectory(const QString &path) {
+    if (!QDir().mkpath(path)) {
+        qWarning() << "Could not create export cache directory:" << path;
+        return false;
+    }
+    m_cacheDir = path;
+    return true;
+}
+
+/**
+ * Class Getters
+ * =============
+ */
+
+/**!
+ * @brief The number of blocks written by the last export.
+ */
+qint64 Exporter::blockCount() const {
+    return m_blocks;
+}
+
+/**!
+ * @brief The number of chapters taken from the cache by the last export.
+ */
+qint64 Exporter::cachedCount() const {
+    return m_cached;
+}
+
+/**
+ * Static Methods
+ * ==============
+ */
+
+/**!
+ * @brief Get the export format matching the extension of a file path.
+ *
+ * @param path the output file path.
+ * @return the format, plain text if the extension is not known.
+ */
+Exporter::Format Exporter::formatForPath(const QString &path) {
+    QString suffix = QFileInfo(path).suffix().toLower();
+    if (suffix == "md" || suffix == "markdown") {
+        return Format::Markdown;
+    } else if (suffix == "html" || suffix == "htm") {
+        return Format::Html;
+    } else if (suffix == "pdf") {
+        return Format::Pdf;
+    }
+    return Format::PlainText;
+}
+
+/**!
+ * @brief Get the export format from its name.
+ *
+ * @param name   the format name, one of text, markdown, html or pdf.
+ * @param format receives the format.
+ * @return false if the name is not known.
+ */
+bool Exporter::parseFormat(const QString &name, Format &format) {
+    QString lower = name.toLower();
+    if (lower == "text" || lower == "txt") {
+        format = Format::PlainText;
+    } else if (lower == "markdown" || lower == "md") {
+        format = Format::Markdown;
+    } else if (lower == "html") {
+        format = Format::Html;
+    } else if (lower == "pdf") {
+        format = Format::Pdf;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Internal Functions
+ * ==================
+ */
+
+/**!
+ * @brief Encode a chapter into its own output buffer.
+ *
+ * This runs on the thread pool, so it only touches the chapter and its own
+ * exporter and content reader.
+ *
+ * @param chapter  the chapter to encode.
+ * @param format   the export format.
+ * @param reader   the opened reader of a flat project, or null if the
+ *                 chapter holds its JSON content.
+ * @param cacheDir the build cache directory, or empty for no cache.
+ */
+void Exporter::encodeChapter(Chapter &chapter, Format format, const ContentReader *reader, const QString &cacheDir) {
+
+    QString cachePath;
+    if (!cacheDir.isEmpty()) {
+        chapter.cacheName = Exporter::chapterHash(chapter, format, reader) + Exporter::cacheSuffix(format);
+        cachePath = QDir(cacheDir).filePath(chapter.cacheName);
+        if (Exporter::readCache(cachePath, chapter)) {
+            return;
+        }
+    }
+
+    Exporter exporter(nullptr, format);
+    exporter.m_blocks = chapter.first;
+
+    if (reader) {
+        QScopedPointer<ContentReader> local(new ContentReader(*reader));
+        for (qsizetype i = chapter.from; i < chapter.to; i++) {
+            if (local->readBlock(i)) {
+                const ContentBlock &block = local->block();
+                exporter.writeBlock(FormatCodec::decodeBlock(block.format), block.fragments);
+            }
+        }
+    } else if (chapter.table) {
+        exporter.writeContent(*chapter.table, chapter.from, chapter.to);
+    } else {
+        exporter.writeContent(chapter.content, chapter.from, chapter.to);
+    }
+
+    chapter.output = std::move(exporter.m_buffer);
+    chapter.written = exporter.m_blocks - chapter.first;
+
+    if (!cachePath.isEmpty()) {
+        Exporter::writeCache(cachePath, chapter);
+    }
+}
+
+/**!
+ * @brief Hash the source of a chapter.
+ *
+ * The hash covers the export format and whether the chapter is the first
+ * in the output, since the first block has no separator. Flat projects are
+ * hashed from the raw block data, content tables from their formats and
+ * run text, and JSON content from the block formats and fragments.
+ *
+ * @param chapter the chapter to hash.
+ * @param format  the export format.
+ * @param reader  the opened reader of a flat project, or null.
+ * @param salt    extra data the output depends on.
+ * @return the hash as a hex string.
+ */
+QString Exporter::chapterHash(const Chapter &chapter, Format format, const ContentReader *reader, const QByteArray &salt) {
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(QByteArrayView(COL_EXPORT_CACHE_MAGIC));
+
+    const char head[2] = {static_cast<char>('0' + format), chapter.first == 0 ? 'F' : 'N'};
+    hash.addData(QByteArrayView(head, 2));
+    hash.addData(salt);
+
+    auto addValue = [&hash](quint32 value) {
+        quint32 big = qToBigEndian(value);
+        hash.addData(QByteArrayView(reinterpret_cast<const char *>(&big), sizeof(big)));
+    };
+    auto addText = [&hash, &addValue](const QString &text) {
+        addValue(static_cast<quint32>(text.size()));
+        hash.addData(QByteArrayView(reinterpret_cast<const char *>(text.constData()), text.size()*sizeof(QChar)));
+    };
+
+    if (reader) {
+        hash.addData(reader->blockData(chapter.from, chapter.to));
+    } else if (chapter.table) {
+        const ContentTable &table = *chapter.table;
+        for (qsizetype i = chapter.from; i < chapter.to; i++) {
+            addValue(table.blockFormat(i));
+            addValue(static_cast<quint32>(table.runCount(i)));
+            for (qsizetype r = 0; r < table.runCount(i); r++) {
+                quint32 charFmt = 0;
+                QByteArrayView text = table.runText(i, r, charFmt);
+                addValue(charFmt);
+                addValue(static_cast<quint32>(text.size()));
+                hash.addData(text);
+            }
+        }
+    } else {
+        for (qsizetype i = chapter.from; i < chapter.to; i++) {
+            QJsonObject jBlock = chapter.content.at(i).toObject();
+            addValue(FormatCodec::decodeBlockValue(jBlock.value(QLatin1String("u:fmt"))));
+            QJsonValue jText = jBlock.value(QLatin1String("u:txt"));
+            if (jText.isString()) {
+                addValue(1);
+                addText(jText.toString());
+            } else {
+                QJsonArray jFrags = jBlock.value(QLatin1String("x:txt")).toArray();
+                addValue(static_cast<quint32>(jFrags.size()));
+                for (const QJsonValue &jFrag : jFrags) {
+                    addText(jFrag.toString());
+                }
+            }
+        }
+    }
+
+    return QString::fromLatin1(hash.result().toHex());
+}
+
+/**!
+ * @brief The file name suffix of cache entries in a format.
+ */
+QString Exporter::cacheSuffix(Format format) {
+    switch (format) {
+        case Format::Markdown: return ".md.chunk";
+        case Format::Html:     return ".html.chunk";
+        case Format::Pdf:      return ".pdf.pages";
+        default:               return ".txt.chunk";
+    }
+}
+
+/**!
+ * @brief Read the output of a chapter from a cache entry.
+ *
+ * An entry holds the number of blocks written as a big endian integer,
+ * followed by the encoded output.
+ *
+ * @param path    the cache entry path.
+ * @param chapter the chapter to receive the output.
+ * @return true if a valid entry was read.
+ */
+bool Exporter::readCache(const QString &path, Chapter &chapter) {
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QByteArray data = file.readAll();
+    if (data.size() < static_cast<qsizetype>(sizeof(qint64))) {
+        return false;
+    }
+
+    chapter.written = qFromBigEndian<qint64>(data.constData());
+    chapter.output = data.sliced(sizeof(qint64));
+    chapter.cached = true;
+
+    return true;
+}
+
+/**!
+ * @brief Write the output of a chapter to a cache entry.
+ *
+ * The entry is written through a save file, so a failed or concurrent
+ * write never leaves a partial entry behind.
+ *
+ * @param path    the cache entry path.
+ * @param chapter the encoded chapter.
+ */
+void Exporter::writeCache(const QString &path, const Chapter &chapter) {
+
+    qint64 written = qToBigEndian(chapter.written);
+
+    QSaveFile file(path);
+    if (
+        !file.open(QIODevice::WriteOnly)
+        || file.write(reinterpret_cast<const char *>(&written), sizeof(written)) != sizeof(written)
+        || file.write(chapter.output) != chapter.output.size()
+        || !file.commit()
+    ) {
+        qWarning() << "Could not write export cache entry:" << path;
+    }
+}
+
+/**!
+ * @brief Lay out a chapter and record its pages.
+ *
+ * This runs on the thread pool. The cache is checked first, so a cached
+ * chapter is never built or laid out. Otherwise the chapter is built into
+ * a text document laid out against its own image with a resolution of 72
+ * dpi, so its units are points and no paint device is shared between
+ * threads. Each page is then recorded as a picture, which is all that is
+ * left for the thread of the application to paint.
+ *
+ * @param chapter   the chapter to lay out.
+ * @param reader    the opened reader of a flat project, or null if the
+ *                  chapter holds its content.
+ * @param styles    the text styles.
+ * @param pageSize  the size of the page text area in points.
+ * @param layoutKey the style and page values the layout depends on.
+ * @param cacheDir  the build cache directory, or empty for no cache.
+ */
+void Exporter::layoutChapter(
+    Chapter &chapter, const ContentReader *reader, const StyleRegistry &styles,
+    const QSizeF &pageSize, const QByteArray &layoutKey, const QString &cacheDir
+) {
+    chapter.written = chapter.to - chapter.from;
+
+    QString cachePath;
+    if (!cacheDir.isEmpty()) {
+        chapter.cacheName = Exporter::chapterHash(chapter, Format::Pdf, reader, layoutKey)
+                          + Exporter::cacheSuffix(Format::Pdf);
+        cachePath = QDir(cacheDir).filePath(chapter.cacheName);
+        chapter.cached = Exporter::readPageCache(cachePath, chapter.pages);
+        if (chapter.cached) {
+            return;
+        }
+    }
+
+    int dotsPerMeter = qRound(72.0 / 0.0254);
+    QImage device(1, 1, QImage::Format_Mono);
+    device.setDotsPerMeterX(dotsPerMeter);
+    device.setDotsPerMeterY(dotsPerMeter);
+
+    DocumentBuilder builder(styles);
+    std::unique_ptr<QTextDocument> document = builder.newDocument();
+    document->documentLayout()->setPaintDevice(&device);
+    document->setDocumentMargin(0.0);
+    document->setTextWidth(pageSize.width());
+
+    QTextCursor cursor(document.get());
+    if (reader) {
+        QScopedPointer<ContentReader> local(new ContentReader(*reader));
+        builder.insertBlocks(cursor, *local, chapter.from, chapter.to, true);
+    } else if (chapter.table) {
+        builder.insertBlocks(cursor, *chapter.table, chapter.from, chapter.to, true);
+    } else {
+        builder.insertBlocks(cursor, chapter.content, chapter.from, chapter.to, true);
+    }
+
+    qreal height = document->documentLayout()->documentSize().height();
+    QList<qreal> breaks = Exporter::paginate(*document, pageSize.height());
+    chapter.pages.clear();
+    for (qsizetype i = 0; i < breaks.size(); i++) {
+        qreal top = breaks.at(i);
+        qreal bottom = i + 1 < breaks.size() ? breaks.at(i + 1) : height;
+
+        QPicture page;
+        QPainter painter(&page);
+        painter.translate(0.0, -top);
+        document->drawContents(&painter, QRectF(0.0, top, pageSize.width(), bottom - top));
+        painter.end();
+        chapter.pages.append(page);
+    }
+
+    if (!cachePath.isEmpty()) {
+        Exporter::writePageCache(cachePath, chapter.pages);
+    }
+}
+
+/**!
+ * @brief Find the page breaks of a laid out document.
+ *
+ * A page breaks before the first line that does not fit below the top of
+ * the page, so lines are never split across pages.
+ *
+ * @param document   the laid out document.
+ * @param pageHeight the height of a page.
+ * @return the position of the top of each page, starting with 0.
+ */
+QList<qreal> Exporter::paginate(const QTextDocument &document, qreal pageHeight) {
+
+    QList<qreal> breaks = {0.0};
+    for (QTextBlock block = document.begin(); block.isValid(); block = block.next()) {
+        const QTextLayout *layout = block.layout();
+        qreal blockTop = layout->position().y();
+        for (int i = 0; i < layout->lineCount(); i++) {
+            QTextLine line = layout->lineAt(i);
+            qreal top = blockTop + line.y();
+            qreal pageTop = breaks.constLast();
+            if (top > pageTop && top + line.height() - pageTop > pageHeight) {
+                breaks.append(top);
+            }
+        }
+    }
+
+    return breaks;
+}
+
+/**!
+ * @brief Read the recorded pages of a chapter from a cache entry.
+ *
+ * @param path  the cache entry path.
+ * @param pages the list to receive the pages.
+ * @return true if a valid entry was read.
+ */
+bool Exporter::readPageCache(const QString &path, QList<QPicture> &pages) {
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_6_0);
+
+    QByteArray magic;
+    stream >> magic;
+    if (magic != COL_EXPORT_PAGES_MAGIC) {
+        return false;
+    }
+    stream >> pages;
+
+    return stream.status() == QDataStream::Ok && !pages.isEmpty();
+}
+
+/**!
+ * @brief Write the recorded pages of a chapter to a cache entry.
+ *
+ * @param path  the cache entry path.
+ * @param pages the recorded pages.
+ */
+void Exporter::writePageCache(const QString &path, const QList<QPicture> &pages) {
+
+    QSaveFile file(path);
+    if (file.open(QIODevice::WriteOnly)) {
+        QDataStream stream(&file);
+        stream.setVersion(QDataStream::Qt_6_0);
+        stream << QByteArray(COL_EXPORT_PAGES_MAGIC) << pages;
+        if (stream.status() == QDataStream::Ok && file.commit()) {
+            return;
+        }
+    }
+    qWarning() << "Could not write export cache entry:" << path;
+}
+
+/**!
+ * @brief Split the blocks of a content reader into chapters.
+ *
+ * A chapter starts at every level 1 or 2 heading.
+ *
+ * @param chapters the list to append the chapters to.
+ * @param reader   the opened content reader.
+ */
+void Exporter::splitChapters(QList<Chapter> &chapters, ContentReader &reader) {
+
+    Chapter chapter;
+    chapter.first = m_blocks;
+    for (qsizetype i = 0; i < reader.count(); i++) {
+        QStringView format;
+        reader.readFormat(i, format);
+        int hLevel = FormatCodec::headingLevel(FormatCodec::decodeBlock(format));
+        if ((hLevel == 1 || hLevel == 2) && i > chapter.from) {
+            chapter.to = i;
+            chapters.append(chapter);
+            chapter.first += i - chapter.from;
+            chapter.from = i;
+        }
+    }
+    chapter.to = reader.count();
+    if (chapter.to > chapter.from) {
+        chapters.append(chapter);
+    }
+}
+
+/**!
+ * @brief Split a list of JSON content blocks into chapters.
+ *
+ * @param chapters the list to append the chapters to.
+ * @param content  the JSON content blocks.
+ */
+void Exporter::splitChapters(QList<Chapter> &chapters, const QJsonArray &content) {
+
+    Chapter chapter;
+    chapter.content = content;
+    chapter.first = m_blocks;
+    if (!chapters.isEmpty()) {
+        const Chapter &last = chapters.constLast();
+        chapter.first = last.first + last.to - last.from;
+    }
+
+    for (qsizetype i = 0; i < content.size(); i++) {
+        QJsonValue jFormat = content.at(i).toObject().value(QLatin1String("u:fmt"));
+        int hLevel = FormatCodec::headingLevel(FormatCodec::decodeBlockValue(jFormat));
+        if ((hLevel == 1 || hLevel == 2) && i > chapter.from) {
+            chapter.to = i;
+            chapters.append(chapter);
+            chapter.first += i - chapter.from;
+            chapter.from = i;
+        }
+    }
+    chapter.to = content.size();
+    if (chapter.to > chapter.from) {
+        chapters.append(chapter);
+    }
+}
+
+/**!
+ * @brief Split the blocks of a content table into chapters.
+ *
+ * The chapters share the table, which stays mapped until the last of them
+ * has been written.
+ *
+ * @param chapters the list to append the chapters to.
+ * @param table    the opened content table.
+ */
+void Exporter::splitChapters(QList<Chapter> &chapters, const QSharedPointer<ContentTable> &table) {
+
+    Chapter chapter;
+    chapter.table = table;
+    chapter.first = m_blocks;
+    if (!chapters.isEmpty()) {
+        const Chapter &last = chapters.constLast();
+        chapter.first = last.first + last.to - last.from;
+    }
+
+    for (qsizetype i = 0; i < table->count(); i++) {
+        int hLevel = FormatCodec::headingLevel(table->blockFormat(i));
+        if ((hLevel == 1 || hLevel == 2) && i > chapter.from) {
+            chapter.to = i;
+            chapters.append(chapter);
+            chapter.first += i - chapter.from;
+            chapter.from = i;
+        }
+    }
+    chapter.to = table->count();
+    if (chapter.to > chapter.from) {
+        chapters.append(chapter);
+    }
+}
+
+/**!
+ * @brief Encode a list of chapters and write them in order.
+ *
+ * The chapters are encoded in batches, so only a few chapters of output
+ * are held in memory at once. The list is cleared when done.
+ *
+ * @param chapters the chapters to write.
+ * @param reader   the opened reader of a flat project, or null.
+ */
+void Exporter::writeChapters(QList<Chapter> &chapters, const ContentReader *reader) {
+
+    Format format = m_format;
+    QString cacheDir = m_cacheDir;
+    QSizeF pageSize = m_pageSize;
+    QByteArray layoutKey = m_layoutKey;
+    const StyleRegistry *styles = format == Format::Pdf ? &CollettSettings::instance()->textStyles() : nullptr;
+    auto encode = [format, reader, cacheDir, pageSize, layoutKey, styles](Chapter &chapter) {
+        if (format == Format::Pdf) {
+            Exporter::layoutChapter(chapter, reader, *styles, pageSize, layoutKey, cacheDir);
+        } else {
+            Exporter::encodeChapter(chapter, format, reader, cacheDir);
+        }
+    };
+
+    qsizetype batchSize = COL_EXPORT_BATCH_SIZE * m_pool.maxThreadCount();
+    for (qsizetype from = 0; from < chapters.size(); from += batchSize) {
+
+        QList<Chapter> batch = chapters.mid(from, batchSize);
+        if (m_pool.maxThreadCount() > 1 && batch.size() > 1) {
+            QtConcurrent::blockingMap(&m_pool, batch, encode);
+        } else {
+            for (Chapter &chapter : batch) {
+                encode(chapter);
+            }
+        }
+
+        for (Chapter &chapter : batch) {
+            if (format == Format::Pdf) {
+                this->paintChapter(chapter);
+                chapter.pages.clear();
+            } else {
+                m_buffer.append(chapter.output);
+            }
+            m_blocks = chapter.first + chapter.written;
+            if (!chapter.cacheName.isEmpty()) {
+                m_cacheUsed.insert(chapter.cacheName);
+            }
+            if (chapter.cached) {
+                m_cached++;
+            }
+            chapter.output.clear();
+            this->checkBuffer();
+        }
+    }
+
+    chapters.clear();
+}
+
+/**!
+ * @brief Paint the recorded pages of a chapter to the PDF output.
+ *
+ * The chapter starts on a new page, and each recorded page is replayed on
+ * a page of its own.
+ *
+ * @param chapter the laid out chapter.
+ */
+void Exporter::paintChapter(const Chapter &chapter) {
+
+    if (!m_painter) {
+        return;
+    }
+
+    for (const QPicture &page : chapter.pages) {
+        if (m_hasPage) {
+            m_pdfWriter->newPage();
+        }
+        m_hasPage = true;
+        m_painter->drawPicture(0, 0, page);
+    }
+}
+
+/**!
+ * @brief Remove the cache entries in the current format that were not
+ * used by the last export.
+ */
+void Exporter::pruneCache() {
+
+    if (m_cacheDir.isEmpty()) {
+        return;
+    }
+
+    QDir cacheDir(m_cacheDir);
+    const QStringList entries = cacheDir.entryList({"*" + Exporter::cacheSuffix(m_format)}, QDir::Files);
+    for (const QString &entry : entries) {
+        if (!m_cacheUsed.contains(entry)) {
+            cacheDir.remove(entry);
+        }
+    }
+}
+
+void Exporter::writeHeader(const QString &title) {
+    if (m_format == Format::Html) {
+        this->writeLatin1(QLatin1String(
+            "<!DOCTYPE html>\n<html>\n<head>\n<meta charset=\"utf-8\">\n<title>"
+        ));
+        this->writeEscaped(title);
+        this->writeLatin1(QLatin1String("</title>\n</head>\n<body>\n"));
+    } else if (m_format == Format::Pdf) {
+        m_pdfWriter.reset(new QPdfWriter(m_device));
+        m_pdfWriter->setTitle(title);
+        m_pdfWriter->setCreator(QString("Collett %1").arg(COL_VERSION_STR));
+        m_pdfWriter->setPageLayout(QPageLayout(
+            QPageSize(QPageSize::A4), QPageLayout::Portrait,
+            QMarginsF(20.0, 20.0, 20.0, 20.0), QPageLayout::Millimeter
+        ));
+
+        // The chapters are laid out in points, and the layout key holds
+        // everything besides the blocks that the page breaks depend on
+        const StyleRegistry &styles = CollettSettings::instance()->textStyles();
+        m_pageSize = m_pdfWriter->pageLayout().paintRect(QPageLayout::Point).size();
+        m_layoutKey = QString("%1|%2|%3|%4|%5x%6")
+            .arg(QFont().family())
+            .arg(styles.fontSize())
+            .arg(styles.tabWidth())
+            .arg(styles.lineHeight())
+            .arg(m_pageSize.width())
+            .arg(m_pageSize.height())
+            .toUtf8();
+
+        m_hasPage = false;
+        m_painter.reset(new QPainter());
+        if (!m_painter->begin(m_pdfWriter.data())) {
+            qWarning() << "Could not start writing PDF output";
+            m_painter.reset();
+            m_failed = true;
+            return;
+        }
+        qreal scale = m_pdfWriter->resolution() / 72.0;
+        m_painter->scale(scale, scale);
+    }
+}
+
+void Exporter::writeFooter() {
+    if (m_format == Format::Html) {
+        this->writeLatin1(QLatin1String("</body>\n</html>\n"));
+    } else if (m_format == Format::Pdf) {
+        if (m_painter && !m_painter->end()) {
+            m_failed = true;
+        }
+        m_painter.reset();
+        m_pdfWriter.reset();
+    }
+}
+
+/**!
+ * @brief Write a range of JSON content blocks.
+ *
+ * @param content the JSON content blocks.
+ * @param from    the index of the first block to write.
+ * @param to      the index after the last block to write.
+ */
+void Exporter::writeContent(const QJsonArray &content, qsizetype from, qsizetype to) {
+
+    QStringList fragments;
+    QVarLengthArray<QStringView, 8> views;
+    for (qsizetype i = from; i < to; i++) {
+
+        QJsonObject jBlock = content.at(i).toObject();
+        fragments.clear();
+        views.clear();
+
+        QJsonValue jText = jBlock.value(QLatin1String("u:txt"));
+        if (jText.isString()) {
+            fragments.append(jText.toString());
+        } else {
+            for (const QJsonValue &jFrag : jBlock.value(QLatin1String("x:txt")).toArray()) {
+                fragments.append(jFrag.toString());
+            }
+        }
+        for (const QString &fragment : fragments) {
+            views.append(fragment);
+        }
+
+        this->writeBlock(FormatCodec::decodeBlockValue(jBlock.value(QLatin1String("u:fmt"))), views);
+        this->checkBuffer();
+    }
+}
+
+/**!
+ * @brief Write a range of blocks from a content table.
+ *
+ * @param table the opened content table.
+ * @param from  the index of the first block to write.
+ * @param to    the index after the last block to write.
+ */
+void Exporter::writeContent(const ContentTable &table, qsizetype from, qsizetype to) {
+
+    QStringList fragments;
+    QVarLengthArray<QStringView, 8> views;
+    for (qsizetype i = from; i < to; i++) {
+
+        fragments.clear();
+        views.clear();
+
+        for (qsizetype r = 0; r < table.runCount(i); r++) {
+            quint32 charFmt = 0;
+            QString text = QString::fromUtf8(table.runText(i, r, charFmt));
+            fragments.append(FormatCodec::encodeFragment(charFmt ? charFmt : FormatCodec::CharText, text));
+        }
+        for (const QString &fragment : fragments) {
+            views.append(fragment);
+        }
+
+        this->writeBlock(table.blockFormat(i), views);
+        this->checkBuffer();
+    }
+}
+
+/**!
+ * @brief Write a single block.
+ *
+ * @param blockFmt  the block format bitmask.
+ * @param fragments the text fragments, with their format prefix.
+ */
+void Exporter::writeBlock(quint32 blockFmt, const QVarLengthArray<QStringView, 8> &fragments) {
+
+    // Headings are bold by their style, so that is not repeated in the text
+    int hLevel = FormatCodec::headingLevel(blockFmt);
+    quint32 charMask = hLevel > 0 ? ~static_cast<quint32>(FormatCodec::CharBold) : ~0u;
+
+    switch (m_format) {
+    case Format::PlainText:
+    case Format::Pdf:
+        if (m_blocks > 0) this->writeLatin1(QLatin1String("\n"));
+        break;
+    case Format::Markdown:
+        if (m_blocks > 0) this->writeLatin1(QLatin1String("\n"));
+        if (hLevel > 0) {
+            m_buffer.append(hLevel, '#');
+            m_buffer.append(' ');
+        }
+        break;
+    case Format::Html:
+        if (hLevel > 0) {
+            m_buffer.append("<h").append(static_cast<char>('0' + hLevel));
+        } else {
+            m_buffer.append("<p");
+        }
+        switch (blockFmt & FormatCodec::AlignMask) {
+            case FormatCodec::AlignCenter:  m_buffer.append(" style=\"text-align: center\""); break;
+            case FormatCodec::AlignRight:   m_buffer.append(" style=\"text-align: right\""); break;
+            case FormatCodec::AlignJustify: m_buffer.append(" style=\"text-align: justify\""); break;
+            default: break;
+        }
+        m_buffer.append('>');
+        break;
+    }
+
+    for (QStringView fragment : fragments) {
+        quint32 charFmt = 0;
+        qsizetype pos = FormatCodec::splitFragment(fragment, charFmt);
+        if (pos < 0) {
+            this->writeFragment(FormatCodec::CharText, fragment);
+        } else if (charFmt & FormatCodec::CharText) {
+            this->writeFragment(charFmt & charMask, fragment.sliced(pos + 1));
+        }
+    }
+
+    if (m_format == Format::Html) {
+        if (hLevel > 0) {
+            m_buffer.append("</h").append(static_cast<char>('0' + hLevel)).append(">\n");
+        } else {
+            m_buffer.append("</p>\n");
+        }
+    } else {
+        m_buffer.append('\n');
+    }
+
+    m_blocks++;
+}
+
+/**!
+ * @brief Write a text fragment with its char format.
+ *
+ * Markdown emphasis cannot start or end with a space, so spaces at the
+ * ends of a fragment are written outside the markers.
+ *
+ * @param charFmt the char format bitmask.
+ * @param text    the fragment text.
+ */
+void Exporter::writeFragment(quint32 charFmt, QStringView text) {
+
+    if (m_format == Format::PlainText) {
+        this->writeEscaped(text);
+        return;
+    }
+
+    qsizetype start = 0;
+    qsizetype end = text.size();
+    if (m_format == Format::Markdown) {
+        while (start < end && text.at(start).isSpace()) start++;
+        while (end > start && text.at(end - 1).isSpace()) end--;
+    }
+    if (start == end) {
+        this->writeEscaped(text);
+        return;
+    }
+
+    struct Marker {
+        quint32 flag;
+        const char *open;
+        const char *close;
+    };
+    static const Marker htmlMarkers[] = {
+        {FormatCodec::CharBold,      "<strong>", "</strong>"},
+        {FormatCodec::CharItalic,    "<em>",     "</em>"},
+        {FormatCodec::CharUnderline, "<u>",      "</u>"},
+        {FormatCodec::CharStrike,    "<s>",      "</s>"},
+        {FormatCodec::CharSuper,     "<sup>",    "</sup>"},
+        {FormatCodec::CharSub,       "<sub>",    "</sub>"},
+    };
+    static const Marker markdownMarkers[] = {
+        {FormatCodec::CharBold,      "**",    "**"},
+        {FormatCodec::CharItalic,    "_",     "_"},
+        {FormatCodec::CharUnderline, "<u>",   "</u>"},
+        {FormatCodec::CharStrike,    "~~",    "~~"},
+        {FormatCodec::CharSuper,     "<sup>", "</sup>"},
+        {FormatCodec::CharSub,       "<sub>", "</sub>"},
+    };
+    const Marker *markers = m_format == Format::Html ? htmlMarkers : markdownMarkers;
+    constexpr int markerCount = 6;
+
+    this->writeEscaped(text.first(start));
+    for (int i = 0; i < markerCount; i++) {
+        if (charFmt & markers[i].flag) m_buffer.append(markers[i].open);
+    }
+    this->writeEscaped(text.sliced(start, end - start));
+    for (int i = markerCount - 1; i >= 0; i--) {
+        if (charFmt & markers[i].flag) m_buffer.append(markers[i].close);
+    }
+    this->writeEscaped(text.sliced(end));
+}
+
+/**!
+ * @brief Write text with the characters that are special in the format
+ * escaped, and line breaks converted.
+ *
+ * @param text the text to write.
+ */
+void Exporter::writeEscaped(QStringView text) {
+
+    qsizetype start = 0;
+    for (qsizetype i = 0; i < text.size(); i++) {
+
+        char16_t c = text.at(i).unicode();
+        const char *escape = nullptr;
+        char escaped[3] = {'\\', 0, 0};
+
+        if (c == u'\n' || c == QChar::LineSeparator) {
+            switch (m_format) {
+                case Format::PlainText:
+                case Format::Pdf:       escape = "\n"; break;
+                case Format::Markdown:  escape = "\\\n"; break;
+                case Format::Html:      escape = "<br>\n"; break;
+            }
+        } else if (m_format == Format::Html) {
+            switch (c) {
+                case u'&': escape = "&amp;"; break;
+                case u'<': escape = "&lt;"; break;
+                case u'>': escape = "&gt;"; break;
+                case u'"': escape = "&quot;"; break;
+                default: break;
+            }
+        } else if (m_format == Format::Markdown) {
+            switch (c) {
+                case u'\\': case u'*': case u'_': case u'`': case u'#': case u'~':
+                case u'[': case u']': case u'<': case u'>': case u'|':
+                    escaped[1] = static_cast<char>(c);
+                    escape = escaped;
+                    break;
+                default: break;
+            }
+        }
+
+        if (escape) {
+            this->writeText(text.sliced(start, i - start));
+            m_buffer.append(escape);
+            start = i + 1;
+        }
+    }
+    this->writeText(text.sliced(start));
+}
+
+/**!
+ * @brief Encode text as UTF-8 straight into the buffer.
+ */
+void Exporter::writeText(QStringView text) {
+    if (text.isEmpty()) {
+        return;
+    }
+    qsizetype size = m_buffer.size();
+    m_buffer.resize(size + m_encoder.requiredSpace(text.size()));
+    char *end = m_encoder.appendToBuffer(m_buffer.data() + size, text);
+    m_buffer.resize(end - m_buffer.constData());
+}
+
+void Exporter::writeLatin1(QLatin1String text) {
+    m_buffer.append(text.data(), text.size());
+}
+
+void Exporter::checkBuffer() {
+    if (m_device && m_buffer.size() >= COL_EXPORT_BUFFER_SIZE) {
+        this->flush();
+    }
+}
+
+} // namespace Collett
@@ -0,0 +1,153 @@
+/*
+** Collett – Core Exporter Class
+** =============================
+**
+** This file is a part of Collett
+** Copyright 2020–2024, Veronica Berglyd Olsen
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef COLLETT_EXPORTER_H
+#define COLLETT_EXPORTER_H
+
+#include "collett.h"
+#include "contentreader.h"
+#include "contenttable.h"
+#include "project.h"
+#include "styleregistry.h"
+
+#include <QByteArray>
+#include <QIODevice>
+#include <QJsonArray>
+#include <QLatin1String>
+#include <QList>
+#include <QPainter>
+#include <QPdfWriter>
+#include <QPicture>
+#include <QScopedPointer>
+#include <QSet>
+#include <QSharedPointer>
+#include <QSizeF>
+#include <QString>
+#include <QStringEncoder>
+#include <QStringView>
+#include <QTextDocument>
+#include <QThreadPool>
+#include <QVarLengthArray>
+
+namespace Collett {
+
+class Exporter
+{
+
+public:
+    enum Format{PlainText, Markdown, Html, Pdf};
+
+    explicit Exporter(QIODevice *device, Format format);
+    ~Exporter();
+
+    // Class Methods
+
+    bool exportProject(Project &project);
+    bool flush();
+
+    // Class Setters
+
+    void setThreadCount(int count);
+    bool setCacheDirectory(const QString &path);
+
+    // Class Getters
+
+    qint64 blockCount() const;
+    qint64 cachedCount() const;
+
+    // Static Methods
+
+    static Format formatForPath(const QString &path);
+    static bool parseFormat(const QString &name, Format &format);
+
+private:
+    struct Chapter {
+        qint64     first = 0;
+        qsizetype  from = 0;
+        qsizetype  to = 0;
+        QJsonArray content;
+        QSharedPointer<ContentTable> table;
+        QByteArray output;
+        qint64     written = 0;
+        QString    cacheName;
+        bool       cached = false;
+
+        QList<QPicture> pages;
+    };
+
+    QIODevice     *m_device;
+    Format         m_format;
+    QByteArray     m_buffer;
+    QStringEncoder m_encoder;
+    bool           m_failed = false;
+    qint64         m_blocks = 0;
+    QThreadPool    m_pool;
+
+    // Build Cache
+
+    QString       m_cacheDir;
+    QSet<QString> m_cacheUsed;
+    qint64        m_cached = 0;
+
+    // PDF Output
+
+    QScopedPointer<QPdfWriter> m_pdfWriter;
+    QScopedPointer<QPainter>   m_painter;
+    QSizeF                     m_pageSize;
+    QByteArray                 m_layoutKey;
+    bool                       m_hasPage = false;
+
+    static void encodeChapter(Chapter &chapter, Format format, const ContentReader *reader, const QString &cacheDir);
+    static QString chapterHash(
+        const Chapter &chapter, Format format, const ContentReader *reader, const QByteArray &salt = QByteArray()
+    );
+    static QString cacheSuffix(Format format);
+    static bool readCache(const QString &path, Chapter &chapter);
+    static void writeCache(const QString &path, const Chapter &chapter);
+    static void layoutChapter(
+        Chapter &chapter, const ContentReader *reader, const StyleRegistry &styles,
+        const QSizeF &pageSize, const QByteArray &layoutKey, const QString &cacheDir
+    );
+    static QList<qreal> paginate(const QTextDocument &document, qreal pageHeight);
+    static bool readPageCache(const QString &path, QList<QPicture> &pages);
+    static void writePageCache(const QString &path, const QList<QPicture> &pages);
+
+    void splitChapters(QList<Chapter> &chapters, ContentReader &reader);
+    void splitChapters(QList<Chapter> &chapters, const QJsonArray &content);
+    void splitChapters(QList<Chapter> &chapters, const QSharedPointer<ContentTable> &table);
+    void writeChapters(QList<Chapter> &chapters, const ContentReader *reader);
+    void pruneCache();
+    void paintChapter(const Chapter &chapter);
+    void writeHeader(const QString &title);
+    void writeFooter();
+    void writeContent(const QJsonArray &content, qsizetype from, qsizetype to);
+    void writeContent(const ContentTable &table, qsizetype from, qsizetype to);
+    void writeBlock(quint32 blockFmt, const QVarLengthArray<QStringView, 8> &fragments);
+    void writeFragment(quint32 charFmt, QStringView text);
+    void writeEscaped(QStringView text);
+    void writeText(QStringView text);
+    void writeLatin1(QLatin1String text);
+    void checkBuffer();
+
+};
+} // namespace Collett
+
+#endif // COLLETT_EXPORTER_H
@@ -0,0 +1,319 @@
+/*
+** Collett – Core Format Codec Class
+** =================================
+**
+** This file is a part of Collett
+** Copyright 2020–2024, Veronica Berglyd Olsen
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "formatcodec.h"
+
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QString>
+#include <QStringView>
+
+namespace Collett {
+
+/**
+ * Format Codec
+ * ============
+ * Converts the formats of the project file to bitmasks of the BlockFlag and
+ * CharFlag values, and back.
+ *
+ * Format version 2 stores the bitmasks directly. The block format is an
+ * integer, and fragments are prefixed with the char format as a decimal
+ * number, like "3|text".
+ *
+ * Format version 1 used colon separated tags, like "p:al:ti:in2" for blocks
+ * and "t:b:i|text" for fragments. These are still decoded, by walking the
+ * string once and mapping each tag through a switch on its packed
+ * characters, so no strings or lists are allocated.
+ */
+
+namespace {
+
+/**!
+ * @brief Pack a tag of up to three ASCII characters into an integer key.
+ */
+constexpr quint32 packTag(const char *tag) {
+    quint32 key = 0;
+    for (int i = 0; i < 3 && tag[i] != '\0'; i++) {
+        key = (key << 8) | static_cast<quint8>(tag[i]);
+    }
+    return key;
+}
+
+/**!
+ * @brief Pack a tag token into an integer key, or 0 if it cannot be a tag.
+ */
+quint32 tokenKey(QStringView token) {
+    if (token.isEmpty() || token.size() > 3) {
+        return 0;
+    }
+    quint32 key = 0;
+    for (QChar c : token) {
+        if (c.unicode() > 0x7f) {
+            return 0;
+        }
+        key = (key << 8) | c.unicode();
+    }
+    return key;
+}
+
+quint32 blockTypeMask(QStringView token) {
+    switch (tokenKey(token)) {
+        case packTag("p"):  return FormatCodec::BlockParagraph;
+        case packTag("h1"): return FormatCodec::BlockHeader1;
+        case packTag("h2"): return FormatCodec::BlockHeader2;
+        case packTag("h3"): return FormatCodec::BlockHeader3;
+        case packTag("h4"): return FormatCodec::BlockHeader4;
+        default: return FormatCodec::BlockNone;
+    }
+}
+
+quint32 blockFlagMask(QStringView token) {
+    switch (tokenKey(token)) {
+        case packTag("al"): return FormatCodec::AlignLeft;
+        case packTag("ac"): return FormatCodec::AlignCenter;
+        case packTag("at"): return FormatCodec::AlignRight;
+        case packTag("aj"): return FormatCodec::AlignJustify;
+        case packTag("ti"): return FormatCodec::TextIndent;
+        case packTag("sg"): return FormatCodec::TextSegment;
+        default: break;
+    }
+    // Indent levels are written as "in" followed by the level
+    if (token.size() > 2 && token.startsWith(QLatin1String("in"))) {
+        int level = token.last().digitValue();
+        if (level > 0) {
+            return static_cast<quint32>(level) << FormatCodec::IndentShift;
+        }
+    }
+    return 0;
+}
+
+quint32 charMask(QStringView token) {
+    switch (tokenKey(token)) {
+        case packTag("t"):   return FormatCodec::CharText;
+        case packTag("b"):   return FormatCodec::CharBold;
+        case packTag("i"):   return FormatCodec::CharItalic;
+        case packTag("u"):   return FormatCodec::CharUnderline;
+        case packTag("s"):   return FormatCodec::CharStrike;
+        case packTag("sup"): return FormatCodec::CharSuper;
+        case packTag("sub"): return FormatCodec::CharSub;
+        default: return 0;
+    }
+}
+
+/**!
+ * @brief Parse a format version 2 bitmask written as a decimal number.
+ *
+ * @return false if the string is not a plain number.
+ */
+bool parseMask(QStringView format, quint32 &mask) {
+    if (format.isEmpty() || format.size() > 10) {
+        return false;
+    }
+    quint64 value = 0;
+    for (QChar c : format) {
+        if (c < QLatin1Char('0') || c > QLatin1Char('9')) {
+            return false;
+        }
+        value = value*10 + (c.unicode() - '0');
+    }
+    mask = static_cast<quint32>(value);
+    return true;
+}
+
+} // namespace
+
+/**
+ * Decoders
+ * ========
+ */
+
+/**!
+ * @brief Decode a block format string.
+ *
+ * A number is a version 2 bitmask. Otherwise, the first tag must be the
+ * block type, and the remaining tags are flags. Unknown tags are ignored.
+ *
+ * @param format the block format string.
+ * @return the block format bitmask.
+ */
+quint32 FormatCodec::decodeBlock(QStringView format) {
+
+    quint32 mask = 0;
+    if (parseMask(format, mask)) {
+        return mask;
+    }
+
+    bool isFirst = true;
+    qsizetype start = 0;
+    while (start <= format.size()) {
+        qsizetype end = format.indexOf(':', start);
+        if (end < 0) {
+            end = format.size();
+        }
+        QStringView token = format.sliced(start, end - start);
+        if (isFirst) {
+            mask |= blockTypeMask(token);
+            isFirst = false;
+        } else {
+            quint32 flag = blockFlagMask(token);
+            if (flag & AlignMask) {
+                mask &= ~AlignMask;
+            }
+            if (flag & IndentMask) {
+                mask &= ~IndentMask;
+            }
+            mask |= flag;
+        }
+        start = end + 1;
+    }
+
+    return mask;
+}
+
+/**!
+ * @brief Decode a block format value of either format version.
+ *
+ * @param format the u:fmt value of a block.
+ * @return the block format bitmask.
+ */
+quint32 FormatCodec::decodeBlockValue(const QJsonValue &format) {
+    if (format.isDouble()) {
+        return static_cast<quint32>(format.toInteger());
+    }
+    return FormatCodec::decodeBlock(format.toString());
+}
+
+/**!
+ * @brief Decode a text fragment format string.
+ *
+ * @param format the fragment format string, without the text.
+ * @return the char format bitmask.
+ */
+quint32 FormatCodec::decodeChar(QStringView format) {
+
+    quint32 mask = 0;
+    if (parseMask(format, mask)) {
+        return mask;
+    }
+
+    qsizetype start = 0;
+    while (start <= format.size()) {
+        qsizetype end = format.indexOf(':', start);
+        if (end < 0) {
+            end = format.size();
+        }
+        mask |= charMask(format.sliced(start, end - start));
+        start = end + 1;
+    }
+
+    return mask;
+}
+
+/**!
+ * @brief Decode the format prefix of a text fragment like "3|text".
+ *
+ * @param fragment   the full fragment string.
+ * @param charFormat receives the char format bitmask.
+ * @return the position of the separator, or -1 if there is none.
+ */
+qsizetype FormatCodec::splitFragment(QStringView fragment, quint32 &charFormat) {
+    qsizetype pos = fragment.indexOf('|');
+    charFormat = pos < 0 ? 0 : FormatCodec::decodeChar(fragment.first(pos));
+    return pos;
+}
+
+/**
+ * Encoders
+ * ========
+ */
+
+/**!
+ * @brief Encode a text fragment with its char format bitmask.
+ *
+ * @param charFormat the char format bitmask.
+ * @param text       the fragment text.
+ * @return the fragment string.
+ */
+QString FormatCodec::encodeFragment(quint32 charFormat, QStringView text) {
+    QString result;
+    result.reserve(text.size() + 4);
+    result.append(QString::number(charFormat)).append('|').append(text);
+    return result;
+}
+
+/**!
+ * @brief Convert a content block to format version 2.
+ *
+ * Blocks already in version 2 are returned unchanged.
+ *
+ * @param block the JSON content block.
+ * @return the converted block.
+ */
+QJsonObject FormatCodec::migrateBlock(const QJsonObject &block) {
+
+    QJsonObject result = block;
+    result[QLatin1String("u:fmt")] = static_cast<qint64>(FormatCodec::decodeBlockValue(block.value(QLatin1String("u:fmt"))));
+
+    auto migrateFragment = [](const QString &fragment) {
+        quint32 charFmt = 0;
+        qsizetype pos = FormatCodec::splitFragment(fragment, charFmt);
+        return pos < 0 ? fragment : FormatCodec::encodeFragment(charFmt, QStringView(fragment).sliced(pos + 1));
+    };
+
+    QJsonValue jText = block.value(QLatin1String("u:txt"));
+    if (jText.isString()) {
+        result[QLatin1String("u:txt")] = migrateFragment(jText.toString());
+    } else if (block.contains(QLatin1String("x:txt"))) {
+        QJsonArray jFrags;
+        for (const QJsonValue &jFrag : block.value(QLatin1String("x:txt")).toArray()) {
+            jFrags.append(migrateFragment(jFrag.toString()));
+        }
+        result[QLatin1String("x:txt")] = jFrags;
+    }
+
+    return result;
+}
+
+/**
+ * Helpers
+ * =======
+ */
+
+/**!
+ * @brief Get the heading level of a block format.
+ *
+ * @param blockFormat the block format bitmask.
+ * @return the heading level 1 to 4, or 0 if the block is not a heading.
+ */
+int FormatCodec::headingLevel(quint32 blockFormat) {
+    quint32 type = blockFormat & BlockTypeMask;
+    if (type >= BlockHeader1 && type <= BlockHeader4) {
+        return static_cast<int>(type - BlockHeader1) + 1;
+    }
+    return 0;
+}
+
+int FormatCodec::indentLevel(quint32 blockFormat) {
+    return static_cast<int>((blockFormat & IndentMask) >> IndentShift);
+}
+
+} // namespace Collett
@@ -0,0 +1,89 @@
+/*
+** Collett – Core Format Codec Class
+** =================================
+**
+** This file is a part of Collett
+** Copyright 2020–2024, Veronica Berglyd Olsen
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef COLLETT_FORMAT_CODEC_H
+#define COLLETT_FORMAT_CODEC_H
+
+#include "collett.h"
+
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QString>
+#include <QStringView>
+
+namespace Collett {
+
+class FormatCodec
+{
+
+public:
+    static constexpr int Version = 2;
+
+    enum BlockFlag : quint32 {
+        BlockTypeMask  = 0x0007,
+        BlockNone      = 0x0000,
+        BlockParagraph = 0x0001,
+        BlockHeader1   = 0x0002,
+        BlockHeader2   = 0x0003,
+        BlockHeader3   = 0x0004,
+        BlockHeader4   = 0x0005,
+        AlignMask      = 0x0038,
+        AlignLeft      = 0x0008,
+        AlignCenter    = 0x0010,
+        AlignRight     = 0x0018,
+        AlignJustify   = 0x0020,
+        TextIndent     = 0x0040,
+        TextSegment    = 0x0080,
+        IndentMask     = 0x0f00,
+        IndentShift    = 8,
+    };
+
+    enum CharFlag : quint32 {
+        CharText      = 0x0001,
+        CharBold      = 0x0002,
+        CharItalic    = 0x0004,
+        CharUnderline = 0x0008,
+        CharStrike    = 0x0010,
+        CharSuper     = 0x0020,
+        CharSub       = 0x0040,
+    };
+
+    // Decoders
+
+    static quint32 decodeBlock(QStringView format);
+    static quint32 decodeBlockValue(const QJsonValue &format);
+    static quint32 decodeChar(QStringView format);
+    static qsizetype splitFragment(QStringView fragment, quint32 &charFormat);
+
+    // Encoders
+
+    static QString encodeFragment(quint32 charFormat, QStringView text);
+    static QJsonObject migrateBlock(const QJsonObject &block);
+
+    // Helpers
+
+    static int headingLevel(quint32 blockFormat);
+    static int indentLevel(quint32 blockFormat);
+
+};
+} // namespace Collett
+
+#endif // COLLETT_FORMAT_CODEC_H
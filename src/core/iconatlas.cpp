@@ -0,0 +1,181 @@
+/*
+** Collett – Core Icon Atlas Class
+** ===============================
+**
+** This file is a part of Collett
+** Copyright 2020–2024, Veronica Berglyd Olsen
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "iconatlas.h"
+#include "icontable.h"
+
+#include <algorithm>
+#include <iterator>
+
+#include <QByteArray>
+#include <QPainter>
+#include <QRect>
+#include <QSvgRenderer>
+
+namespace Collett {
+
+/**
+ * Icon Atlas
+ * ==========
+ * All icons of the icon table rendered into a single image, in one colour
+ * for the normal and one for the active mode. Each pixel size has a row of
+ * square cells, with the normal and active cells of each icon next to each
+ * other.
+ *
+ * The icons are rendered in black from the SVG data and then filled with
+ * the icon colour. The atlas only uses QImage and QSvgRenderer, so it can
+ * be built on a worker thread.
+ */
+
+IconAtlas::IconAtlas(quint32 generation) : m_generation(generation) {}
+
+/**
+ * Class Getters
+ * =============
+ */
+
+/**!
+ * @brief The icon style generation the atlas was built for.
+ */
+quint32 IconAtlas::generation() const {
+    return m_generation;
+}
+
+QColor IconAtlas::normalColor() const {
+    return m_normalColor;
+}
+
+QColor IconAtlas::activeColor() const {
+    return m_activeColor;
+}
+
+bool IconAtlas::contains(int pixelSize) const {
+    return m_rows.contains(pixelSize);
+}
+
+/**!
+ * @brief Get a single icon from the atlas.
+ *
+ * @param index     the index of the icon in the icon table.
+ * @param pixelSize the size of the icon in device pixels.
+ * @param active    true for the active mode colour.
+ * @return the icon image, or a null image if the size is not in the atlas.
+ */
+QImage IconAtlas::icon(int index, int pixelSize, bool active) const {
+    auto row = m_rows.constFind(pixelSize);
+    if (row == m_rows.constEnd() || index < 0 || index >= IconAtlas::iconCount()) {
+        return QImage();
+    }
+    int x = (2*index + (active ? 1 : 0))*pixelSize;
+    return m_image.copy(QRect(x, row.value(), pixelSize, pixelSize));
+}
+
+/**
+ * Static Methods
+ * ==============
+ */
+
+/**!
+ * @brief Render all icons into a new atlas.
+ *
+ * @param generation the icon style generation.
+ * @param pixelSizes the icon sizes to render, in device pixels.
+ * @param normal     the colour of icons in normal mode.
+ * @param active     the colour of icons in active mode.
+ * @return the new atlas.
+ */
+std::shared_ptr<const IconAtlas> IconAtlas::build(
+    quint32 generation, const QList<int> &pixelSizes, const QColor &normal, const QColor &active
+) {
+    std::shared_ptr<IconAtlas> atlas = std::make_shared<IconAtlas>(generation);
+    atlas->m_normalColor = normal;
+    atlas->m_activeColor = active;
+
+    int count = IconAtlas::iconCount();
+    int width = 0;
+    int height = 0;
+    for (int size : pixelSizes) {
+        if (size > 0 && !atlas->m_rows.contains(size)) {
+            atlas->m_rows.insert(size, height);
+            width = std::max(width, 2*count*size);
+            height += size;
+        }
+    }
+    if (width == 0 || height == 0) {
+        return atlas;
+    }
+
+    atlas->m_image = QImage(width, height, QImage::Format_ARGB32_Premultiplied);
+    atlas->m_image.fill(Qt::transparent);
+
+    QPainter painter(&atlas->m_image);
+    for (int i = 0; i < count; i++) {
+        QSvgRenderer renderer(IconAtlas::iconSvg(i));
+        for (auto row = atlas->m_rows.constBegin(); row != atlas->m_rows.constEnd(); ++row) {
+            int size = row.key();
+            QRect normalRect(2*i*size, row.value(), size, size);
+            IconAtlas::paintIcon(painter, renderer, normalRect, normal);
+            IconAtlas::paintIcon(painter, renderer, normalRect.translated(size, 0), active);
+        }
+    }
+    painter.end();
+
+    return atlas;
+}
+
+/**!
+ * @brief Paint an icon in a given colour.
+ *
+ * The area of the rectangle must be transparent before the icon is painted.
+ *
+ * @param painter  the painter to paint with.
+ * @param renderer the renderer of the icon SVG.
+ * @param rect     the area to paint the icon in.
+ * @param color    the icon colour.
+ */
+void IconAtlas::paintIcon(QPainter &painter, QSvgRenderer &renderer, const QRect &rect, const QColor &color) {
+    renderer.render(&painter, rect);
+    painter.setCompositionMode(QPainter::CompositionMode_SourceIn);
+    painter.fillRect(rect, color);
+    painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+}
+
+/**!
+ * @brief Get the SVG document of an icon, without colours.
+ *
+ * @param index the index of the icon in the icon table.
+ * @return the SVG data.
+ */
+QByteArray IconAtlas::iconSvg(int index) {
+    if (index < 0 || index >= IconAtlas::iconCount()) {
+        return QByteArray();
+    }
+    return QByteArray(ICON_TABLE[index].head).append(ICON_TABLE[index].body);
+}
+
+/**!
+ * @brief The number of icons in the icon table.
+ */
+int IconAtlas::iconCount() {
+    return static_cast<int>(std::size(ICON_TABLE));
+}
+
+} // namespace Collett
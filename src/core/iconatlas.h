@@ -0,0 +1,74 @@
+/*
+** Collett – Core Icon Atlas Class
+** ===============================
+**
+** This file is a part of Collett
+** Copyright 2020–2024, Veronica Berglyd Olsen
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef COLLETT_ICON_ATLAS_H
+#define COLLETT_ICON_ATLAS_H
+
+#include "collett.h"
+
+#include <memory>
+
+#include <QByteArray>
+#include <QColor>
+#include <QHash>
+#include <QImage>
+#include <QList>
+#include <QPainter>
+#include <QRect>
+#include <QSvgRenderer>
+
+namespace Collett {
+
+class IconAtlas
+{
+
+public:
+    explicit IconAtlas(quint32 generation);
+    ~IconAtlas() {};
+
+    // Class Getters
+
+    quint32 generation() const;
+    QColor normalColor() const;
+    QColor activeColor() const;
+    bool contains(int pixelSize) const;
+    QImage icon(int index, int pixelSize, bool active) const;
+
+    // Static Methods
+
+    static std::shared_ptr<const IconAtlas> build(
+        quint32 generation, const QList<int> &pixelSizes, const QColor &normal, const QColor &active
+    );
+    static void paintIcon(QPainter &painter, QSvgRenderer &renderer, const QRect &rect, const QColor &color);
+    static QByteArray iconSvg(int index);
+    static int iconCount();
+
+private:
+    quint32 m_generation;
+    QColor m_normalColor;
+    QColor m_activeColor;
+    QImage m_image;
+    QHash<int, int> m_rows;
+
+};
+} // namespace Collett
+
+#endif // COLLETT_ICON_ATLAS_H
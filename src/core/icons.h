@@ -23,11 +23,15 @@
 #define COLLETT_ICONS_H
 
 #include "collett.h"
+#include "iconatlas.h"
 
-#include <QByteArray>
+#include <memory>
+
+#include <QColor>
+#include <QFutureWatcher>
 #include <QHash>
 #include <QIcon>
-#include <QSize>
+#include <QList>
 
 namespace Collett {
 
@@ -43,17 +47,32 @@ public:
     ~CollettIcons();
 
     void setIconStyle(const QColor &normal, const QColor &active);
+    void updateIconStyle();
 
     QIcon icon(const QString &name);
     bool contains(const QString &name);
+    std::shared_ptr<const IconAtlas> atlas() const;
 
 private:
     static CollettIcons *staticInstance;
 
-    QByteArray m_svgNormal = "<svg viewBox='0 0 512 512'><path d='{data}'/></svg>";
-    QByteArray m_svgActive = "<svg viewBox='0 0 512 512'><path d='{data}'/></svg>";
-    QHash<QString, QByteArray> m_svgPath;
-    QHash<QString, QSize>      m_svgSize;
+    QHash<QString, QIcon> m_icons;
+
+    // Icon Atlas
+
+    std::shared_ptr<const IconAtlas> m_atlas;
+    QFutureWatcher<std::shared_ptr<const IconAtlas>> m_atlasWatcher;
+    quint32 m_generation = 0;
+
+    QList<int> atlasSizes() const;
+
+    static int iconIndex(const QString &name);
+
+signals:
+    void iconStyleChanged();
+
+private slots:
+    void processAtlasFinished();
 
 };
 } // namespace Collett
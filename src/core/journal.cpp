@@ -0,0 +1,344 @@
+/*
+** Collett – Core Journal Class
+** ============================
+**
+** This file is a part of Collett
+** Copyright 2020–2024, Veronica Berglyd Olsen
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "journal.h"
+#include "storage.h"
+
+#include <QCryptographicHash>
+#include <QFile>
+#include <QList>
+#include <QSaveFile>
+#include <QByteArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonParseError>
+#include <QJsonValue>
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
+namespace Collett {
+
+/**
+ * Edit Journal
+ * ============
+ * An append-only file of edit records kept next to the project file. Each
+ * record is one line of compact JSON with an increasing sequence number under
+ * "m:seq" and a checksum under "m:sum". The project file stores the sequence
+ * number of the last record it includes, so after a crash the records past
+ * that number are replayed.
+ *
+ * A line that cannot be read is skipped, and reading resumes at the next
+ * valid record. A torn record is harmless, since it was never reported as
+ * written, and the next record reuses its sequence number. A gap in the
+ * sequence means a written record was lost, and the records from the gap
+ * on cannot be replayed safely.
+ */
+
+Journal::Journal(const QString &path, qint64 sequence) :
+    m_file(path), m_sequence(sequence) {}
+
+Journal::~Journal() {
+    m_file.close();
+}
+
+/**
+ * Class Methods
+ * =============
+ */
+
+/**!
+ * @brief Append a record to the journal.
+ *
+ * The record is assigned the next sequence number. Unless the durability is
+ * Direct, the file is synced to disk before returning.
+ *
+ * @param record the edit record.
+ * @return true if the record was written.
+ */
+bool Journal::append(QJsonObject record) {
+
+    if (!m_file.isOpen() && !this->openForAppend()) {
+        return false;
+    }
+
+    record[QLatin1String("m:seq")] = m_sequence + 1;
+    record.remove(QLatin1String("m:sum"));
+    record[QLatin1String("m:sum")] = Journal::checksum(record);
+    QByteArray line = QJsonDocument(record).toJson(QJsonDocument::Compact).append('\n');
+    if (m_file.write(line) != line.size() || !m_file.flush()) {
+        m_lastError = tr("Could not write to journal: %1").arg(m_file.fileName());
+        qWarning() << "Could not write to journal:" << m_file.fileName();
+        return false;
+    }
+
+#ifdef Q_OS_UNIX
+    if (m_durability != Storage::Direct) {
+        ::fsync(m_file.handle());
+    }
+#endif
+
+    m_sequence++;
+
+    return true;
+}
+
+/**!
+ * @brief Read the records that are newer than the journal's sequence number.
+ *
+ * The sequence number is advanced past the records read, so that new records
+ * are appended after them.
+ *
+ * @param records the list to receive the records.
+ * @return true if the journal could be read, or does not exist.
+ */
+bool Journal::replay(QList<QJsonObject> &records) {
+
+    if (!this->readRecords(m_sequence, records)) {
+        return false;
+    }
+    if (!records.isEmpty()) {
+        m_sequence = records.last().value(QLatin1String("m:seq")).toInteger();
+    }
+    qDebug() << "Found" << records.size() << "journal records to replay";
+
+    return true;
+}
+
+/**!
+ * @brief Drop the records that are included in a saved project file.
+ *
+ * If all records are saved, the journal is truncated. Otherwise, the records
+ * added while the project was being saved are kept.
+ *
+ * @param sequence the last sequence number included in the saved file.
+ * @return true if the journal was updated.
+ */
+bool Journal::checkpoint(qint64 sequence) {
+
+    m_file.close();
+    if (!QFile::exists(m_file.fileName())) {
+        return true;
+    }
+
+    QList<QJsonObject> records;
+    if (sequence < m_sequence && !this->readRecords(sequence, records)) {
+        return false;
+    }
+
+    QSaveFile file(m_file.fileName());
+    if (!file.open(QIODevice::WriteOnly)) {
+        m_lastError = tr("Could not open journal: %1").arg(file.fileName());
+        qWarning() << "Could not open journal:" << file.fileName();
+        return false;
+    }
+    for (QJsonObject record : records) {
+        record[QLatin1String("m:sum")] = Journal::checksum(record);
+        file.write(QJsonDocument(record).toJson(QJsonDocument::Compact).append('\n'));
+    }
+    if (!file.commit()) {
+        m_lastError = tr("Could not write to journal: %1").arg(file.fileName());
+        qWarning() << "Could not write to journal:" << file.fileName();
+        return false;
+    }
+    qDebug() << "Journal checkpoint at" << sequence << "keeping" << records.size() << "records";
+
+    return true;
+}
+
+/**
+ * Class Setters
+ * =============
+ */
+
+void Journal::setDurability(Storage::Durability level) {
+    m_durability = level;
+}
+
+/**
+ * Class Getters
+ * =============
+ */
+
+QString Journal::path() const {
+    return m_file.fileName();
+}
+
+qint64 Journal::lastSequence() const {
+    return m_sequence;
+}
+
+/**!
+ * @brief The number of records lost from the journal in the last read.
+ *
+ * This counts the sequence numbers from the first gap to the last record
+ * found, including readable records after the gap that were not returned.
+ */
+qint64 Journal::lostRecords() const {
+    return m_lost;
+}
+
+qint64 Journal::size() const {
+    return m_file.isOpen() ? m_file.size() : QFile(m_file.fileName()).size();
+}
+
+/**
+ * Error Handling
+ * ==============
+ */
+
+bool Journal::hasError() const {
+    return !m_lastError.isEmpty();
+}
+
+QString Journal::lastError() const {
+    return m_lastError;
+}
+
+/**
+ * Internal Functions
+ * ==================
+ */
+
+/**!
+ * @brief Read the records with a sequence number above a given value.
+ *
+ * Lines that cannot be parsed, or fail their checksum, are skipped. Records
+ * are returned up to the first gap in the sequence, and the number of lost
+ * records is available from lostRecords().
+ *
+ * @param after   the sequence number to read past.
+ * @param records the list to receive the records.
+ * @return true if the journal could be read, or does not exist.
+ */
+bool Journal::readRecords(qint64 after, QList<QJsonObject> &records) {
+
+    m_lost = 0;
+
+    QFile file(m_file.fileName());
+    if (!file.exists()) {
+        return true;
+    }
+    if (!file.open(QIODevice::ReadOnly)) {
+        m_lastError = tr("Could not open journal: %1").arg(file.fileName());
+        qWarning() << "Could not open journal:" << file.fileName();
+        return false;
+    }
+
+    qint64 expected = after + 1;
+    qint64 gapAt = -1;
+    while (!file.atEnd()) {
+        QJsonObject record;
+        if (!Journal::parseRecord(file.readLine(), record)) {
+            qWarning() << "Skipping invalid journal record";
+            continue;
+        }
+
+        qint64 sequence = record.value(QLatin1String("m:seq")).toInteger();
+        if (sequence < expected) {
+            continue;
+        } else if (gapAt < 0 && sequence == expected) {
+            records.append(record);
+            expected++;
+        } else {
+            if (gapAt < 0) {
+                gapAt = expected;
+                qWarning() << "Journal records missing from sequence number" << gapAt;
+            }
+            m_lost = sequence - gapAt + 1;
+        }
+    }
+    file.close();
+
+    return true;
+}
+
+/**!
+ * @brief Parse a journal line and verify its checksum.
+ *
+ * Records written before checksums were added have none, and are accepted
+ * if they parse.
+ *
+ * @param line   the line, including the line feed.
+ * @param record the object to receive the record.
+ * @return true if the line holds a valid record.
+ */
+bool Journal::parseRecord(const QByteArray &line, QJsonObject &record) {
+
+    if (!line.endsWith('\n')) {
+        return false;
+    }
+
+    QJsonParseError error;
+    QJsonDocument json = QJsonDocument::fromJson(line, &error);
+    if (error.error != QJsonParseError::NoError || !json.isObject()) {
+        return false;
+    }
+
+    record = json.object();
+    QJsonValue jSum = record.take(QLatin1String("m:sum"));
+    if (!record.value(QLatin1String("m:seq")).isDouble()) {
+        return false;
+    }
+
+    return jSum.isUndefined() || jSum.toString() == Journal::checksum(record);
+}
+
+/**!
+ * @brief The checksum of a record without its "m:sum" member.
+ */
+QString Journal::checksum(const QJsonObject &record) {
+    QByteArray data = QJsonDocument(record).toJson(QJsonDocument::Compact);
+    return QString::fromLatin1(QCryptographicHash::hash(data, QCryptographicHash::Sha1).toHex().left(8));
+}
+
+/**!
+ * @brief Open the journal for appending records.
+ *
+ * A torn record left by a crash is ended with a line feed first, so that
+ * the next record starts on a line of its own.
+ */
+bool Journal::openForAppend() {
+
+    bool isTorn = false;
+    QFile file(m_file.fileName());
+    if (file.size() > 0 && file.open(QIODevice::ReadOnly) && file.seek(file.size() - 1)) {
+        isTorn = file.read(1) != "\n";
+    }
+    file.close();
+
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        m_lastError = tr("Could not open journal: %1").arg(m_file.fileName());
+        qWarning() << "Could not open journal:" << m_file.fileName();
+        return false;
+    }
+    if (isTorn && m_file.write("\n") != 1) {
+        m_lastError = tr("Could not write to journal: %1").arg(m_file.fileName());
+        qWarning() << "Could not write to journal:" << m_file.fileName();
+        m_file.close();
+        return false;
+    }
+
+    return true;
+}
+
+} // namespace Collett
@@ -0,0 +1,83 @@
+/*
+** Collett – Core Journal Class
+** ============================
+**
+** This file is a part of Collett
+** Copyright 2020–2024, Veronica Berglyd Olsen
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef COLLETT_JOURNAL_H
+#define COLLETT_JOURNAL_H
+
+#include "collett.h"
+#include "storage.h"
+
+#include <QByteArray>
+#include <QFile>
+#include <QList>
+#include <QJsonObject>
+#include <QString>
+
+namespace Collett {
+
+class Journal : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit Journal(const QString &path, qint64 sequence);
+    ~Journal();
+
+    // Class Methods
+
+    bool append(QJsonObject record);
+    bool replay(QList<QJsonObject> &records);
+    bool checkpoint(qint64 sequence);
+
+    // Class Setters
+
+    void setDurability(Storage::Durability level);
+
+    // Class Getters
+
+    QString path() const;
+    qint64 lastSequence() const;
+    qint64 lostRecords() const;
+    qint64 size() const;
+
+    // Error Handling
+
+    bool hasError() const;
+    QString lastError() const;
+
+private:
+    QFile   m_file;
+    qint64  m_sequence;
+    qint64  m_lost = 0;
+    QString m_lastError = "";
+
+    Storage::Durability m_durability = Storage::Atomic;
+
+    bool readRecords(qint64 after, QList<QJsonObject> &records);
+    bool openForAppend();
+
+    static bool parseRecord(const QByteArray &line, QJsonObject &record);
+    static QString checksum(const QJsonObject &record);
+
+};
+} // namespace Collett
+
+#endif // COLLETT_JOURNAL_H
@@ -0,0 +1,296 @@
+/*
+** Collett – Core JSON Writer Class
+** ================================
+**
+** This file is a part of Collett
+** Copyright 2020–2024, Veronica Berglyd Olsen
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "jsonwriter.h"
+
+#define COL_JSON_BUFFER_SIZE 65536
+
+#include <cmath>
+
+#include <QByteArray>
+#include <QIODevice>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QLocale>
+
+namespace Collett {
+
+/**
+ * Streaming JSON Writer
+ * =====================
+ * Writes a JSON object straight to a device through a small buffer. The
+ * indented output is identical to QJsonDocument::Indented with each level of
+ * four spaces replaced by a tab, and the compact output is identical to
+ * QJsonDocument::Compact. No intermediate copy of the document is made.
+ */
+
+JsonWriter::JsonWriter(QIODevice *device, bool compact) :
+    m_device(device), m_compact(compact)
+{
+    m_buffer.reserve(COL_JSON_BUFFER_SIZE + 4096);
+}
+
+JsonWriter::~JsonWriter() {
+    this->flush();
+}
+
+/**
+ * Class Methods
+ * =============
+ */
+
+/**!
+ * @brief Write a full JSON document with an object at its root.
+ *
+ * @param object the root object.
+ * @return true if all data was written to the device.
+ */
+bool JsonWriter::writeDocument(const QJsonObject &object) {
+    this->writeObject(object, 0);
+    if (!m_compact) {
+        m_buffer.append('\n');
+    }
+    return this->flush();
+}
+
+/**!
+ * @brief Write the buffered data to the device.
+ *
+ * @return true if no write has failed so far.
+ */
+bool JsonWriter::flush() {
+    if (m_device == nullptr) {
+        return true;
+    }
+    if (!m_buffer.isEmpty() && !m_failed) {
+        if (m_device->write(m_buffer) != m_buffer.size()) {
+            m_failed = true;
+        }
+        m_written += m_buffer.size();
+        m_buffer.clear();
+    }
+    return !m_failed;
+}
+
+/**!
+ * @brief Record where the members of the root object are written.
+ *
+ * @param state true to record the spans of the root object's values.
+ */
+void JsonWriter::setTrackMembers(bool state) {
+    m_trackMembers = state;
+}
+
+/**!
+ * @brief The number of bytes written so far, including the buffer.
+ */
+qint64 JsonWriter::position() const {
+    return m_written + m_buffer.size();
+}
+
+/**!
+ * @brief Get the span of a value in the root object.
+ *
+ * Member tracking must be enabled before the document is written.
+ *
+ * @param key the key of the member.
+ * @return the byte offset and length of the value, or (0, 0) if unknown.
+ */
+QPair<qint64, qint64> JsonWriter::memberSpan(const QString &key) const {
+    return m_spans.value(key, QPair<qint64, qint64>(0, 0));
+}
+
+/**!
+ * @brief Serialise a single value in the same format as a full document.
+ *
+ * @param value   the value to serialise.
+ * @param indent  the indentation level the value is written at.
+ * @param compact true for compact output.
+ * @return the serialised value.
+ */
+QByteArray JsonWriter::toBytes(const QJsonValue &value, int indent, bool compact) {
+    JsonWriter writer(nullptr, compact);
+    writer.writeValue(value, indent);
+    return writer.m_buffer;
+}
+
+/**
+ * Internal Functions
+ * ==================
+ */
+
+void JsonWriter::writeValue(const QJsonValue &value, int indent) {
+    switch (value.type()) {
+        case QJsonValue::Null:   m_buffer.append("null"); break;
+        case QJsonValue::Bool:   m_buffer.append(value.toBool() ? "true" : "false"); break;
+        case QJsonValue::Double: this->writeNumber(value.toDouble()); break;
+        case QJsonValue::String: this->writeString(value.toString()); break;
+        case QJsonValue::Array:  this->writeArray(value.toArray(), indent); break;
+        case QJsonValue::Object: this->writeObject(value.toObject(), indent); break;
+        default: break;
+    }
+}
+
+void JsonWriter::writeObject(const QJsonObject &object, int indent) {
+
+    m_buffer.append(m_compact ? "{" : "{\n");
+
+    bool isFirst = true;
+    for (auto it = object.constBegin(); it != object.constEnd(); ++it) {
+        if (!isFirst) {
+            m_buffer.append(m_compact ? "," : ",\n");
+        }
+        isFirst = false;
+        this->writeIndent(indent + 1);
+        this->writeString(it.key());
+        m_buffer.append(m_compact ? ":" : ": ");
+        qint64 start = this->position();
+        this->writeValue(it.value(), indent + 1);
+        if (m_trackMembers && indent == 0) {
+            m_spans.insert(it.key(), QPair<qint64, qint64>(start, this->position() - start));
+        }
+        this->checkBuffer();
+    }
+    if (!isFirst && !m_compact) {
+        m_buffer.append('\n');
+    }
+
+    this->writeIndent(indent);
+    m_buffer.append('}');
+}
+
+void JsonWriter::writeArray(const QJsonArray &array, int indent) {
+
+    m_buffer.append(m_compact ? "[" : "[\n");
+
+    bool isFirst = true;
+    for (const QJsonValue &value : array) {
+        if (!isFirst) {
+            m_buffer.append(m_compact ? "," : ",\n");
+        }
+        isFirst = false;
+        this->writeIndent(indent + 1);
+        this->writeValue(value, indent + 1);
+        this->checkBuffer();
+    }
+    if (!isFirst && !m_compact) {
+        m_buffer.append('\n');
+    }
+
+    this->writeIndent(indent);
+    m_buffer.append(']');
+}
+
+/**!
+ * @brief Write a quoted and escaped string.
+ *
+ * The escaping rules follow the Qt JSON writer, so that the output matches
+ * QJsonDocument byte for byte. Unpaired surrogates are written as \u escapes.
+ *
+ * @param text the string to write.
+ */
+void JsonWriter::writeString(const QString &text) {
+
+    static const char hexDigits[] = "0123456789abcdef";
+
+    m_buffer.append('"');
+
+    const char16_t *src = text.utf16();
+    const char16_t *end = src + text.size();
+    while (src != end) {
+        char32_t u = *src++;
+        if (u < 0x80) {
+            if (u < 0x20 || u == '"' || u == '\\') {
+                m_buffer.append('\\');
+                switch (u) {
+                    case '"':  m_buffer.append('"'); break;
+                    case '\\': m_buffer.append('\\'); break;
+                    case 0x08: m_buffer.append('b'); break;
+                    case 0x0c: m_buffer.append('f'); break;
+                    case 0x0a: m_buffer.append('n'); break;
+                    case 0x0d: m_buffer.append('r'); break;
+                    case 0x09: m_buffer.append('t'); break;
+                    default:
+                        m_buffer.append("u00");
+                        m_buffer.append(hexDigits[u >> 4]);
+                        m_buffer.append(hexDigits[u & 0xf]);
+                        break;
+                }
+            } else {
+                m_buffer.append(static_cast<char>(u));
+            }
+        } else if (u < 0x800) {
+            m_buffer.append(static_cast<char>(0xc0 | (u >> 6)));
+            m_buffer.append(static_cast<char>(0x80 | (u & 0x3f)));
+        } else if (QChar::isHighSurrogate(u) && src != end && QChar::isLowSurrogate(*src)) {
+            u = QChar::surrogateToUcs4(static_cast<char16_t>(u), *src++);
+            m_buffer.append(static_cast<char>(0xf0 | (u >> 18)));
+            m_buffer.append(static_cast<char>(0x80 | ((u >> 12) & 0x3f)));
+            m_buffer.append(static_cast<char>(0x80 | ((u >> 6) & 0x3f)));
+            m_buffer.append(static_cast<char>(0x80 | (u & 0x3f)));
+        } else if (QChar::isSurrogate(u)) {
+            m_buffer.append("\\u");
+            m_buffer.append(hexDigits[(u >> 12) & 0xf]);
+            m_buffer.append(hexDigits[(u >> 8) & 0xf]);
+            m_buffer.append(hexDigits[(u >> 4) & 0xf]);
+            m_buffer.append(hexDigits[u & 0xf]);
+        } else {
+            m_buffer.append(static_cast<char>(0xe0 | (u >> 12)));
+            m_buffer.append(static_cast<char>(0x80 | ((u >> 6) & 0x3f)));
+            m_buffer.append(static_cast<char>(0x80 | (u & 0x3f)));
+        }
+    }
+
+    m_buffer.append('"');
+}
+
+/**!
+ * @brief Write a number.
+ *
+ * Integral values within the exact range of a double are written as integers,
+ * as QJsonDocument does for values created from integers.
+ *
+ * @param value the number to write.
+ */
+void JsonWriter::writeNumber(double value) {
+    if (!std::isfinite(value)) {
+        m_buffer.append("null");
+    } else if (std::floor(value) == value && std::fabs(value) < 9007199254740992.0) {
+        m_buffer.append(QByteArray::number(static_cast<qint64>(value)));
+    } else {
+        m_buffer.append(QByteArray::number(value, 'g', QLocale::FloatingPointShortest));
+    }
+}
+
+void JsonWriter::writeIndent(int indent) {
+    if (!m_compact && indent > 0) {
+        m_buffer.append(indent, '\t');
+    }
+}
+
+void JsonWriter::checkBuffer() {
+    if (m_buffer.size() >= COL_JSON_BUFFER_SIZE) {
+        this->flush();
+    }
+}
+
+} // namespace Collett
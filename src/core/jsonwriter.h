@@ -0,0 +1,77 @@
+/*
+** Collett – Core JSON Writer Class
+** ================================
+**
+** This file is a part of Collett
+** Copyright 2020–2024, Veronica Berglyd Olsen
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef COLLETT_JSON_WRITER_H
+#define COLLETT_JSON_WRITER_H
+
+#include "collett.h"
+
+#include <QHash>
+#include <QPair>
+#include <QByteArray>
+#include <QIODevice>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonValue>
+
+namespace Collett {
+
+class JsonWriter
+{
+
+public:
+    explicit JsonWriter(QIODevice *device, bool compact=false);
+    ~JsonWriter();
+
+    // Class Methods
+
+    bool writeDocument(const QJsonObject &object);
+    bool flush();
+
+    void setTrackMembers(bool state);
+
+    qint64 position() const;
+    QPair<qint64, qint64> memberSpan(const QString &key) const;
+
+    static QByteArray toBytes(const QJsonValue &value, int indent, bool compact);
+
+private:
+    QIODevice *m_device;
+    bool       m_compact;
+    bool       m_failed = false;
+    bool       m_trackMembers = false;
+    qint64     m_written = 0;
+    QByteArray m_buffer;
+
+    QHash<QString, QPair<qint64, qint64>> m_spans;
+
+    void writeValue(const QJsonValue &value, int indent);
+    void writeObject(const QJsonObject &object, int indent);
+    void writeArray(const QJsonArray &array, int indent);
+    void writeString(const QString &text);
+    void writeNumber(double value);
+    void writeIndent(int indent);
+    void checkBuffer();
+
+};
+} // namespace Collett
+
+#endif // COLLETT_JSON_WRITER_H
@@ -20,10 +20,25 @@
 */
 
 #include "project.h"
+#include "formatcodec.h"
+#include "journal.h"
+#include "settings.h"
 #include "storage.h"
 
+#define COL_JOURNAL_CHECKPOINT 1048576
+
+// The c:format marker, followed by the format version from version 2 on
+#define COL_PROJECT_FORMAT "CollettProject"
+
+#include <algorithm>
+#include <memory>
+
+#include <QList>
 #include <QDateTime>
+#include <QFile>
 #include <QJsonObject>
+#include <QSharedPointer>
+#include <QtConcurrent>
 
 namespace Collett {
 
@@ -32,11 +47,13 @@ namespace Collett {
  * ============================
  */
 
-Project::Project() {
+Project::Project() : m_cache(qsizetype(1048576)*CollettSettings::instance()->projectCacheSize()) {
     m_createdTime = QDateTime::currentDateTime().toString(Qt::ISODate);
+    connect(&m_saveWatcher, SIGNAL(finished()), this, SLOT(processSaveFinished()));
 }
 
 Project::~Project() {
+    m_saveWatcher.waitForFinished();
     qDebug() << "Destructor: Project";
 }
 
@@ -45,22 +62,43 @@ Project::~Project() {
  * =============
  */
 
-bool Project::openProject(const QString &path) {
+/**!
+ * @brief Open a project.
+ *
+ * A project opened read-only replays its edit journal into memory, but
+ * leaves the journal and the project files on disk as they are, and cannot
+ * be edited or saved in place.
+ *
+ * @param path     the path of the project.
+ * @param readOnly whether to open the project read-only.
+ * @return true if the project was opened.
+ */
+bool Project::openProject(const QString &path, bool readOnly) {
 
-    if (!m_document.isEmpty()) {
+    if (m_isValid) {
         qWarning() << "Project content already loaded";
         return false;
     }
+    m_readOnly = readOnly;
 
-    m_store = new Storage(path, false);
+    m_store = this->createStore(path);
     qInfo() << "Loading Project:" << m_store->projectPath();
     if (!m_store->isValid()) {
+        m_lastError = tr("Cannot load project from this path: %1").arg(path);
         qWarning() << "Cannot load project from this path";
         return false;
     }
 
+    // Flat projects only read the metadata sections here, so that the
+    // document can be streamed into the editor without a JSON object tree
     QJsonObject jData;
-    if (!m_store->readProject(jData)) {
+    bool success = false;
+    if (m_store->saveMode() == Storage::Flat) {
+        success = m_store->peekMeta(jData);
+    } else {
+        success = m_store->readProject(jData);
+    }
+    if (!success) {
         m_lastError = m_store->lastError();
         return false;
     }
@@ -69,96 +107,829 @@ bool Project::openProject(const QString &path) {
     QJsonObject jProject = jData.value(QLatin1String("c:project")).toObject();
     QJsonObject jSettings = jData.value(QLatin1String("c:settings")).toObject();
 
+    // Format Version
+    // Flat projects only have the c:format marker when read in full, so the
+    // version in c:meta is checked as well
+    int formatVersion = jMeta.value(QLatin1String("m:format")).toInt(1);
+    QJsonValue jFormat = jData.value(QLatin1String("c:format"));
+    if (jFormat.isString()) {
+        int markerVersion = Project::markerVersion(jFormat.toString());
+        if (markerVersion < 1) {
+            m_lastError = tr("Not a Collett project: %1").arg(path);
+            qWarning() << "Unknown project format:" << jFormat.toString();
+            return false;
+        }
+        formatVersion = std::max(formatVersion, markerVersion);
+    }
+    if (formatVersion > FormatCodec::Version) {
+        m_lastError = tr(
+            "The project was saved in format version %1, which is newer than this version of Collett can read."
+        ).arg(formatVersion);
+        qWarning() << "Unsupported project format version:" << formatVersion;
+        return false;
+    }
+
     // Project Meta
     m_createdTime = Storage::getJsonString(jMeta, QLatin1String("m:created"), "Unknown");
+    m_formatVersion = formatVersion;
 
     // Project Settings
     m_projectName = Storage::getJsonString(jProject, QLatin1String("u:name"), tr("Unnamed Project"));
+    m_cursorBlock = jSettings.value(QLatin1String("u:cursor")).toInt();
 
     // Project Content
+    // Archive projects only hold the entry index at this point, and flat
+    // projects hold nothing. The content is loaded when it is first needed
     m_document = jData.value(QLatin1String("u:document")).toObject();
+    m_contentLoaded = false;
     m_isValid = true;
 
     if (!jMeta.isEmpty()) qDebug() << "Found meta section";
     if (!jProject.isEmpty()) qDebug() << "Found project section";
     if (!jSettings.isEmpty()) qDebug() << "Found settings section";
-    if (!m_document.isEmpty()) qDebug() << "Found document section";
+    if (m_store->saveMode() == Storage::Archive) qDebug() << "Found" << m_store->entries().size() << "document entries";
+
+    // Replay edits that were journaled after the project was last saved
+    QList<QJsonObject> jRecords;
+    qint64 sequence = jMeta.value(QLatin1String("m:journal")).toInteger();
+    this->openJournal(sequence);
+    bool replayed = m_journal->replay(jRecords);
+    if (replayed && !jRecords.isEmpty()) {
+        replayed = this->loadContent();
+    }
+    if (replayed && !jRecords.isEmpty()) {
+        qInfo() << "Replaying" << jRecords.size() << "journaled edits";
+        for (const QJsonObject &jRecord : jRecords) {
+            this->spliceContent(
+                jRecord.value(QLatin1String("m:at")).toInt(),
+                jRecord.value(QLatin1String("m:remove")).toInt(),
+                Project::migrateContent(jRecord.value(QLatin1String("x:insert")).toArray())
+            );
+        }
+    }
+    if (!replayed) {
+        this->keepJournal(sequence, 0);
+    } else if (m_journal->lostRecords() > 0) {
+        this->keepJournal(sequence, m_journal->lostRecords());
+    }
 
     return true;
 }
 
 bool Project::saveProject() {
 
+    // A background save must finish before the storage is used again, and
+    // a coalesced save request is covered by this save
+    this->settleSave();
+    m_savePending = false;
+
+    if (!this->canSave()) {
+        return false;
+    }
+
+    qint64 sequence = this->journalSequence();
+    if (!Project::writeProject(m_store, this->projectData(), m_edits, this->readsContent(), m_formatVersion)) {
+        m_lastError = m_store->lastError();
+        return false;
+    }
+    if (!m_contentLoaded) {
+        m_edits.clear();
+        m_formatVersion = FormatCodec::Version;
+    }
+    if (m_journal) {
+        m_journal->checkpoint(sequence);
+    }
+
+    return true;
+}
+
+/**!
+ * @brief Save the project on a worker thread.
+ *
+ * The project data is collected on the calling thread, which is cheap as the
+ * JSON objects are implicitly shared, while serialisation and file I/O run
+ * in the background. Content that is not loaded is read and edited on the
+ * save thread too. If a save is already running, the request is coalesced
+ * into a single new save that starts when the current one finishes. The
+ * saveFinished() signal is emitted when each save completes.
+ */
+void Project::saveProjectAsync() {
+
+    if (m_saveWatcher.isRunning()) {
+        m_savePending = true;
+        return;
+    }
+
+    if (!this->canSave()) {
+        emit saveFinished(false);
+        return;
+    }
+
+    Storage *store = m_store;
+    QJsonObject jData = this->projectData();
+    QList<QJsonObject> edits = m_edits;
+    bool readContent = this->readsContent();
+    int formatVersion = m_formatVersion;
+    m_saveSequence = this->journalSequence();
+    m_saveEdits = m_contentLoaded ? 0 : m_edits.size();
+    m_saveWatcher.setFuture(QtConcurrent::run([store, jData, edits, readContent, formatVersion]() {
+        return Project::writeProject(store, jData, edits, readContent, formatVersion);
+    }));
+}
+
+bool Project::saveProjectAs(const QString &path) {
+    // The content must be read from the current storage before switching
+    this->settleSave();
+    if (!this->loadContent()) {
+        return false;
+    }
+    m_store = this->createStore(path);
+    m_isValid = true;
+    m_readOnly = false;
+    this->openJournal(this->journalSequence());
+    return this->saveProject();
+}
+
+/**!
+ * @brief Apply an edit to the document content and record it in the journal.
+ *
+ * The edit replaces a range of content blocks. It is appended to the edit
+ * journal, so it survives a crash without rewriting the project file. When
+ * the journal grows past a threshold, a background save is started, which
+ * checkpoints the journal when it completes.
+ *
+ * If the content is not loaded, as when a flat project is streamed into the
+ * editor, the edit is kept until the content is loaded or saved, so that an
+ * edit never loads the content.
+ *
+ * @param at       the index of the first block to replace.
+ * @param removed  the number of blocks to remove.
+ * @param inserted the blocks to insert at the index.
+ * @return true if the edit was applied and journaled.
+ */
+bool Project::applyEdit(int at, int removed, const QJsonArray &inserted) {
+
+    if (m_readOnly) {
+        m_lastError = tr("The project was opened read-only");
+        return false;
+    }
+
+    QJsonObject jRecord;
+    jRecord[QLatin1String("m:at")] = at;
+    jRecord[QLatin1String("m:remove")] = removed;
+    jRecord[QLatin1String("x:insert")] = inserted;
+
+    if (m_contentLoaded) {
+        this->spliceContent(at, removed, inserted);
+    } else {
+        m_edits.append(jRecord);
+    }
+
+    if (m_journal) {
+        if (!m_journal->append(jRecord)) {
+            m_lastError = m_journal->lastError();
+            return false;
+        }
+        if (m_journal->size() > COL_JOURNAL_CHECKPOINT) {
+            this->saveProjectAsync();
+        }
+    }
+
+    return true;
+}
+
+/**!
+ * @brief Convert a project between storage formats.
+ *
+ * The formats are selected by the file extensions: .fcollett for flat JSON,
+ * .bcollett for flat CBOR and .collett for an archive project.
+ *
+ * @param source the path of the project to convert.
+ * @param target the path to write the converted project to.
+ * @param error  receives the error message if the conversion fails.
+ * @return true if the project was converted.
+ */
+bool Project::convertProject(const QString &source, const QString &target, QString &error) {
+
+    Project project;
+    if (!project.openProject(source, true) || !project.saveProjectAs(target)) {
+        error = project.hasError() ? project.lastError() : tr("Could not convert project: %1").arg(source);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Class Setters
+ * =============
+ */
+
+void Project::setProjectName(const QString &name) {
+    m_projectName = name.simplified();
+}
+
+void Project::setCursorBlock(int block) {
+    m_cursorBlock = std::max(block, 0);
+}
+
+/**!
+ * @brief Replace the document content.
+ *
+ * @param content the content blocks of the document.
+ */
+void Project::setContent(const QJsonArray &content) {
+    m_document.remove(QLatin1String("c:entries"));
+    m_document[QLatin1String("x:content")] = content;
+    m_contentLoaded = true;
+    m_edits.clear();
+}
+
+/**
+ * Class Getters
+ * =============
+ */
+
+bool Project::isValid() const {
+    return m_isValid;
+}
+
+bool Project::isSaving() const {
+    return m_saveWatcher.isRunning();
+}
+
+QString Project::projectName() const {
+    return m_projectName;
+}
+
+int Project::cursorBlock() const {
+    return m_cursorBlock;
+}
+
+Storage *Project::store() {
+    return m_store;
+}
+
+DocumentCache *Project::cache() {
+    return &m_cache;
+}
+
+QJsonObject Project::document() {
+    this->loadContent();
+    return m_document;
+}
+
+/**!
+ * @brief Get a reader that streams the content of a flat project.
+ *
+ * The reader reads the mapped project file, so it only has the content as
+ * of the last save. Once the content has been loaded as JSON objects, or
+ * has been edited since, this returns nullptr.
+ *
+ * @return an open content reader, or nullptr if there is none.
+ */
+std::unique_ptr<ContentReader> Project::contentReader() {
+
+    if (m_contentLoaded || !m_edits.isEmpty() || m_store == nullptr) {
+        return nullptr;
+    }
+
+    QSharedPointer<QFile> file(new QFile);
+    QByteArray data;
+    if (!m_store->mapContentFile(*file, data)) {
+        return nullptr;
+    }
+
+    std::unique_ptr<ContentReader> reader = std::make_unique<ContentReader>(data, file);
+    if (!reader->open()) {
+        return nullptr;
+    }
+
+    return reader;
+}
+
+/**!
+ * @brief Get the number of stored content entries.
+ *
+ * Archive projects store one entry per chapter. Flat projects are treated as
+ * a single entry.
+ *
+ * @return the number of entries.
+ */
+int Project::entryCount() const {
+    if (m_store != nullptr && m_store->saveMode() == Storage::Archive) {
+        return m_store->entries().size();
+    } else {
+        return 1;
+    }
+}
+
+/**!
+ * @brief Get the stored content of a single entry.
+ *
+ * For archive projects, only the requested entry is read from storage, so
+ * this does not require the full document to be loaded. Recently used
+ * entries are served from the document cache, which keeps the memory use of
+ * entry reads within its budget. A fully loaded document is not covered by
+ * the budget.
+ *
+ * @param index the index of the entry.
+ * @return the content blocks of the entry as of the last save.
+ */
+QJsonArray Project::entryContent(int index) {
+
+    if (m_store == nullptr || m_store->saveMode() != Storage::Archive) {
+        this->loadContent();
+        return m_document.value(QLatin1String("x:content")).toArray();
+    }
+
+    QJsonArray jContent;
+    QJsonArray jEntries = m_store->entries();
+    if (index < 0 || index >= jEntries.size()) {
+        return jContent;
+    }
+
+    QString handle = jEntries.at(index).toObject().value(QLatin1String("m:handle")).toString();
+    this->readEntry(handle, jContent);
+
+    return jContent;
+}
+
+/**!
+ * @brief Open the columnar content table of an archive entry.
+ *
+ * Tables hold the content as it was last saved, and only exist for archive
+ * projects saved with columnar tables enabled.
+ *
+ * @param index the entry index.
+ * @param table the table to open.
+ * @return true if the entry has a table and it was opened.
+ */
+bool Project::entryTable(int index, ContentTable &table) {
+
+    if (m_store == nullptr || m_store->saveMode() != Storage::Archive) {
+        return false;
+    }
+
+    QJsonArray jEntries = m_store->entries();
+    if (index < 0 || index >= jEntries.size()) {
+        return false;
+    }
+
+    QString handle = jEntries.at(index).toObject().value(QLatin1String("m:handle")).toString();
+    QString tablePath = m_store->tablePath(handle);
+
+    return !tablePath.isEmpty() && table.open(tablePath);
+}
+
+/**
+ * Internal Functions
+ * ==================
+ */
+
+/**!
+ * @brief Check that the project has a valid storage to save to.
+ *
+ * @return true if the project can be saved.
+ */
+bool Project::canSave() {
+
     if (m_store == nullptr) {
         qWarning() << "Project storage not initialised, cannot save";
         return false;
     }
 
+    if (m_readOnly) {
+        m_lastError = tr("The project was opened read-only");
+        qWarning() << "Project opened read-only, cannot save";
+        return false;
+    }
+
     qInfo() << "Saving Project:" << m_store->projectPath();
     if (!m_store->isValid()) {
         qWarning() << "Project storage invalid, cannot save";
         return false;
     }
 
+    return true;
+}
+
+/**!
+ * @brief Check if a save must read the content from storage.
+ *
+ * A flat file is always written in full, so content that is not loaded
+ * must be read back. An archive only needs its entries read if they must
+ * be edited or converted to the current format version.
+ */
+bool Project::readsContent() const {
+    if (m_contentLoaded) {
+        return false;
+    }
+    return m_store->saveMode() == Storage::Flat || !m_edits.isEmpty() || m_formatVersion < FormatCodec::Version;
+}
+
+/**!
+ * @brief Write project data to storage, reading the content first if it is
+ * not loaded.
+ *
+ * This runs on the save thread for background saves. Content that is not
+ * loaded is read as it was last saved, converted from an older format
+ * version, and the edits made since are applied to it before it is written.
+ *
+ * @param store         the project storage.
+ * @param jData         the project data.
+ * @param edits         the edits to apply to content that is read.
+ * @param readContent   whether the content must be read from storage.
+ * @param formatVersion the format version of the stored content.
+ * @return true if the project was written.
+ */
+bool Project::writeProject(
+    Storage *store, QJsonObject jData, const QList<QJsonObject> &edits, bool readContent, int formatVersion
+) {
+    if (readContent) {
+        QJsonArray jContent;
+        if (!Project::readContent(store, jContent)) {
+            return false;
+        }
+        if (formatVersion < FormatCodec::Version) {
+            jContent = Project::migrateContent(jContent);
+        }
+        for (const QJsonObject &jEdit : edits) {
+            Project::spliceContent(jContent, jEdit);
+        }
+
+        QJsonObject jDocument = jData.value(QLatin1String("u:document")).toObject();
+        jDocument.remove(QLatin1String("c:entries"));
+        jDocument[QLatin1String("x:content")] = jContent;
+        jData[QLatin1String("u:document")] = jDocument;
+    }
+
+    return store->writeProject(jData);
+}
+
+/**!
+ * @brief Wait for a running background save, and drop the edits it wrote.
+ *
+ * Edits kept for content that is not loaded are written by a save, and
+ * must not be applied again to the content read after it.
+ */
+void Project::settleSave() {
+
+    if (m_saveEdits < 0) {
+        return;
+    }
+
+    m_saveWatcher.waitForFinished();
+    if (m_saveWatcher.result()) {
+        m_edits.remove(0, std::min(m_saveEdits, m_edits.size()));
+        m_formatVersion = FormatCodec::Version;
+    }
+    m_saveEdits = -1;
+}
+
+/**!
+ * @brief Collect the project data to be written to storage.
+ *
+ * @return the root object of the project file.
+ */
+QJsonObject Project::projectData() const {
+
     QJsonObject jData, jMeta, jProject, jSettings;
 
     // Project Meta
     jMeta[QLatin1String("m:version")] = QString(COL_VERSION_STR);
     jMeta[QLatin1String("m:created")] = m_createdTime;
     jMeta[QLatin1String("m:updated")] = QDateTime::currentDateTime().toString(Qt::ISODate);
+    jMeta[QLatin1String("m:journal")] = this->journalSequence();
+    jMeta[QLatin1String("m:format")] = FormatCodec::Version;
 
     // Project Settings
     jProject[QLatin1String("u:name")] = m_projectName;
+    jSettings[QLatin1String("u:cursor")] = m_cursorBlock;
 
     // Root Object
-    jData[QLatin1String("c:format")] = "CollettProject";
+    jData[QLatin1String("c:format")] = Project::formatMarker(FormatCodec::Version);
     jData[QLatin1String("c:meta")] = jMeta;
     jData[QLatin1String("c:project")] = jProject;
     jData[QLatin1String("c:settings")] = jSettings;
-    jData[QLatin1String("u:document")] = m_document;
+    jData[QLatin1String("u:document")] = m_contentLoaded ? m_document : QJsonObject();
+
+    return jData;
+}
+
+/**!
+ * @brief Create the storage object for a project path.
+ *
+ * @param path the path of the project.
+ * @return a new storage object configured from the settings.
+ */
+Storage *Project::createStore(const QString &path) {
+    Storage *store = new Storage(path, false);
+    store->setDurability(static_cast<Storage::Durability>(CollettSettings::instance()->projectDurability()));
+    store->setColumnar(CollettSettings::instance()->projectColumnar());
+    return store;
+}
+
+/**!
+ * @brief Open the edit journal of the current storage.
+ *
+ * @param sequence the last journal sequence number included in the project.
+ */
+void Project::openJournal(qint64 sequence) {
+    m_journal.reset(new Journal(m_store->journalPath(), sequence));
+    m_journal->setDurability(static_cast<Storage::Durability>(CollettSettings::instance()->projectDurability()));
+}
+
+/**!
+ * @brief Keep a copy of a journal that could not be replayed in full.
+ *
+ * If nothing could be replayed, the journal is moved out of the way, since
+ * the next save would otherwise truncate it and lose the edits in it for
+ * good. If records were lost part way, the records before the gap have
+ * been replayed. A copy of the journal is then kept, and the journal is
+ * rewritten with only the replayed records, so that new records follow on
+ * from them. The project stays open either way, and the error tells the
+ * user where the journal was kept. A read-only project leaves the journal
+ * as it is, and only reports the error.
+ *
+ * @param sequence the last journal sequence number included in the project.
+ * @param lost     the number of records lost, or 0 if nothing was replayed.
+ */
+void Project::keepJournal(qint64 sequence, qint64 lost) {
+
+    QString journalPath = m_journal->path();
+    QString keptPath = journalPath + ".failed";
+
+    if (m_readOnly) {
+        if (lost > 0) {
+            m_lastError = tr(
+                "%1 unsaved edits could not be recovered from the edit journal: %2"
+            ).arg(lost).arg(journalPath);
+        } else {
+            m_lastError = tr("Unsaved edits could not be recovered from the edit journal: %1").arg(journalPath);
+        }
+        qWarning() << "Could not replay edit journal:" << journalPath;
+        return;
+    }
+
+    QFile::remove(keptPath);
+    if (lost > 0) {
+        if (QFile::copy(journalPath, keptPath) && m_journal->checkpoint(sequence)) {
+            m_lastError = tr(
+                "%1 unsaved edits could not be recovered. The edit journal was kept as: %2"
+            ).arg(lost).arg(keptPath);
+        } else {
+            m_lastError = tr("Unsaved edits could not be recovered from the edit journal: %1").arg(journalPath);
+        }
+        qWarning() << "Lost" << lost << "records from edit journal:" << journalPath;
+        return;
+    }
+
+    m_journal.reset();
+    if (QFile::rename(journalPath, keptPath)) {
+        m_lastError = tr("Unsaved edits could not be recovered. The edit journal was kept as: %1").arg(keptPath);
+    } else {
+        m_lastError = tr("Unsaved edits could not be recovered from the edit journal: %1").arg(journalPath);
+    }
+    qWarning() << "Could not replay edit journal:" << journalPath;
+
+    this->openJournal(sequence);
+}
+
+qint64 Project::journalSequence() const {
+    return m_journal ? m_journal->lastSequence() : 0;
+}
+
+/**!
+ * @brief Replace a range of blocks in the loaded document content.
+ *
+ * @param at       the index of the first block to replace.
+ * @param removed  the number of blocks to remove.
+ * @param inserted the blocks to insert at the index.
+ */
+void Project::spliceContent(int at, int removed, const QJsonArray &inserted) {
+    QJsonArray jContent = m_document.take(QLatin1String("x:content")).toArray();
+    Project::spliceContent(jContent, at, removed, inserted);
+    m_document[QLatin1String("x:content")] = jContent;
+}
 
-    if (!m_store->writeProject(jData)) {
+/**!
+ * @brief Replace a range of blocks in a content array.
+ *
+ * The range is clamped to the content, the same way for edits applied
+ * straight away and edits applied when the content is read.
+ */
+void Project::spliceContent(QJsonArray &content, int at, int removed, const QJsonArray &inserted) {
+
+    at = std::clamp(at, 0, static_cast<int>(content.size()));
+    removed = std::clamp(removed, 0, static_cast<int>(content.size()) - at);
+
+    for (int i = 0; i < removed; i++) {
+        content.removeAt(at);
+    }
+    for (int i = 0; i < inserted.size(); i++) {
+        content.insert(at + i, inserted.at(i));
+    }
+}
+
+/**!
+ * @brief Apply an edit record to a content array.
+ */
+void Project::spliceContent(QJsonArray &content, const QJsonObject &edit) {
+    Project::spliceContent(
+        content,
+        edit.value(QLatin1String("m:at")).toInt(),
+        edit.value(QLatin1String("m:remove")).toInt(),
+        edit.value(QLatin1String("x:insert")).toArray()
+    );
+}
+
+/**!
+ * @brief Read an archive entry through the document cache.
+ *
+ * @param handle  the entry handle.
+ * @param content receives the entry content.
+ * @return true if the entry was found in the cache or read from storage.
+ */
+bool Project::readEntry(const QString &handle, QJsonArray &content) {
+    if (m_cache.lookup(handle, content)) {
+        return true;
+    }
+    if (!m_store->readEntry(handle, content)) {
         m_lastError = m_store->lastError();
         return false;
     }
-
+    m_cache.insert(handle, content);
     return true;
 }
 
-bool Project::saveProjectAs(const QString &path) {
-    m_store = new Storage(path, false);
-    m_isValid = true;
-    return this->saveProject();
+/**!
+ * @brief Load the full document content, if not already loaded.
+ *
+ * Archive entries are read straight from storage rather than through the
+ * document cache. The loaded content is held in full until the project is
+ * closed, so caching the same entries again would only double the memory
+ * use. The cache is cleared for the same reason. Edits made before the
+ * content was loaded are applied to it.
+ *
+ * @return true if the content is available.
+ */
+bool Project::loadContent() {
+
+    if (m_contentLoaded) {
+        return true;
+    }
+    if (m_store == nullptr) {
+        return false;
+    }
+
+    this->settleSave();
+
+    QJsonArray jContent;
+    if (!Project::readContent(m_store, jContent)) {
+        m_lastError = m_store->lastError();
+        return false;
+    }
+
+    m_document.remove(QLatin1String("c:entries"));
+    m_document[QLatin1String("x:content")] = jContent;
+    m_contentLoaded = true;
+    m_cache.clear();
+    this->migrateDocument();
+
+    if (!m_edits.isEmpty()) {
+        jContent = m_document.take(QLatin1String("x:content")).toArray();
+        for (const QJsonObject &jEdit : std::as_const(m_edits)) {
+            Project::spliceContent(jContent, jEdit);
+        }
+        m_document[QLatin1String("x:content")] = jContent;
+        m_edits.clear();
+    }
+
+    return true;
 }
 
-/**
- * Class Setters
- * =============
+/**!
+ * @brief Read the stored content of a project.
+ *
+ * This only uses the storage, so it can run on the save thread.
+ *
+ * @param store   the project storage.
+ * @param content the array to receive the content blocks.
+ * @return true if the content was read.
  */
+bool Project::readContent(Storage *store, QJsonArray &content) {
+
+    if (store->saveMode() == Storage::Flat) {
+        QJsonObject jData;
+        if (!store->readProject(jData)) {
+            return false;
+        }
+        content = jData.value(QLatin1String("u:document")).toObject().value(QLatin1String("x:content")).toArray();
+        return true;
+    }
 
-void Project::setProjectName(const QString &name) {
-    m_projectName = name.simplified();
+    for (const QJsonValue &jEntry : store->entries()) {
+        QJsonArray jSection;
+        QString handle = jEntry.toObject().value(QLatin1String("m:handle")).toString();
+        if (!store->readEntry(handle, jSection)) {
+            return false;
+        }
+        for (const QJsonValue &jBlock : jSection) {
+            content.append(jBlock);
+        }
+    }
+
+    return true;
 }
 
-/**
- * Class Getters
- * =============
+/**!
+ * @brief The c:format marker of a format version.
+ *
+ * Version 1 files are marked "CollettProject", and later versions append
+ * the version number, like "CollettProject2".
  */
+QString Project::formatMarker(int version) {
+    if (version <= 1) {
+        return QStringLiteral(COL_PROJECT_FORMAT);
+    }
+    return QStringLiteral(COL_PROJECT_FORMAT "%1").arg(version);
+}
 
-bool Project::isValid() const {
-    return m_isValid;
+/**!
+ * @brief Get the format version of a c:format marker.
+ *
+ * @param marker the marker string.
+ * @return the version, or 0 if the marker is not a Collett project marker.
+ */
+int Project::markerVersion(const QString &marker) {
+
+    QLatin1String prefix(COL_PROJECT_FORMAT);
+    if (!marker.startsWith(prefix)) {
+        return 0;
+    }
+    if (marker.size() == prefix.size()) {
+        return 1;
+    }
+
+    bool isNumber = false;
+    int version = QStringView(marker).sliced(prefix.size()).toInt(&isNumber);
+
+    return isNumber && version > 1 ? version : 0;
 }
 
-QString Project::projectName() const {
-    return m_projectName;
+/**!
+ * @brief Convert loaded content from an older format version.
+ *
+ * The project is saved in the current format version the next time it is
+ * saved.
+ */
+void Project::migrateDocument() {
+    if (m_formatVersion >= FormatCodec::Version) {
+        return;
+    }
+    qInfo() << "Migrating project content from format version" << m_formatVersion;
+    m_document[QLatin1String("x:content")] = Project::migrateContent(
+        m_document.value(QLatin1String("x:content")).toArray()
+    );
+    m_formatVersion = FormatCodec::Version;
 }
 
-Storage *Project::store() {
-    return m_store;
+/**!
+ * @brief Convert content blocks to the current format version.
+ *
+ * @param content the JSON content blocks.
+ * @return the converted blocks.
+ */
+QJsonArray Project::migrateContent(const QJsonArray &content) {
+    QJsonArray result;
+    for (const QJsonValue &jBlock : content) {
+        result.append(FormatCodec::migrateBlock(jBlock.toObject()));
+    }
+    return result;
 }
 
-QJsonObject Project::document() const {
-    return m_document;
+/**
+ * Private Slots
+ * =============
+ */
+
+void Project::processSaveFinished() {
+
+    this->settleSave();
+
+    bool success = m_saveWatcher.result();
+    if (!success) {
+        m_lastError = m_store->lastError();
+    } else if (m_journal) {
+        m_journal->checkpoint(m_saveSequence);
+    }
+    emit saveFinished(success);
+
+    if (m_savePending) {
+        m_savePending = false;
+        this->saveProjectAsync();
+    }
 }
 
 /**
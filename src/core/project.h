@@ -23,9 +23,21 @@
 #define COLLETT_PROJECT_H
 
 #include "collett.h"
+#include "contentreader.h"
+#include "contenttable.h"
+#include "doccache.h"
+#include "formatcodec.h"
+#include "journal.h"
 #include "storage.h"
 
+#include <memory>
+
+#include <QByteArray>
+#include <QFutureWatcher>
+#include <QJsonArray>
 #include <QJsonObject>
+#include <QList>
+#include <QScopedPointer>
 
 namespace Collett {
 
@@ -39,22 +51,36 @@ public:
 
     // Class Methods
 
-    bool openProject(const QString &path);
+    bool openProject(const QString &path, bool readOnly=false);
     bool saveProject();
+    void saveProjectAsync();
     bool saveProjectAs(const QString &path);
 
+    bool applyEdit(int at, int removed, const QJsonArray &inserted);
+
+    static bool convertProject(const QString &source, const QString &target, QString &error);
+
     // Class Setters
 
     void setProjectName(const QString &name);
+    void setCursorBlock(int block);
+    void setContent(const QJsonArray &content);
 
     // Class Getters
 
     bool isValid() const;
+    bool isSaving() const;
 
     QString projectName() const;
+    int cursorBlock() const;
     Storage *store();
+    DocumentCache *cache();
 
-    QJsonObject document() const;
+    QJsonObject document();
+    std::unique_ptr<ContentReader> contentReader();
+    int entryCount() const;
+    QJsonArray entryContent(int index);
+    bool entryTable(int index, ContentTable &table);
 
     // Error Handling
 
@@ -63,28 +89,74 @@ public:
 
 private:
     bool     m_isValid = false;
+    bool     m_readOnly = false;
     QString  m_lastError = "";
     Storage *m_store = nullptr;
 
+    // Background Save
+
+    QFutureWatcher<bool> m_saveWatcher;
+    bool   m_savePending = false;
+    qint64 m_saveSequence = 0;
+    qsizetype m_saveEdits = -1;
+
+    // Edit Journal
+
+    QScopedPointer<Journal> m_journal;
+
     // Project Meta
 
     QString m_collettVersion = "";
     QString m_projectVersion = "";
     QString m_createdTime = "";
+    int     m_formatVersion = FormatCodec::Version;
 
     // Project Settings
 
     QString m_projectName = "New Project";
+    int     m_cursorBlock = 0;
 
     // Project Content
 
-    QJsonObject m_document;
+    QJsonObject   m_document;
+    bool          m_contentLoaded = true;
+    DocumentCache m_cache;
+
+    // Edits made while the content is not loaded
+    QList<QJsonObject> m_edits;
 
     // File Load & Save
 
+    bool canSave();
+    bool readsContent() const;
+    void settleSave();
+    QJsonObject projectData() const;
+    Storage *createStore(const QString &path);
+    void openJournal(qint64 sequence);
+    void keepJournal(qint64 sequence, qint64 lost);
+    qint64 journalSequence() const;
+    void spliceContent(int at, int removed, const QJsonArray &inserted);
+    static void spliceContent(QJsonArray &content, int at, int removed, const QJsonArray &inserted);
+    static void spliceContent(QJsonArray &content, const QJsonObject &edit);
+    bool readEntry(const QString &handle, QJsonArray &content);
+    bool loadContent();
+    static bool readContent(Storage *store, QJsonArray &content);
+    static bool writeProject(
+        Storage *store, QJsonObject jData, const QList<QJsonObject> &edits, bool readContent, int formatVersion
+    );
+    void migrateDocument();
+    static QString formatMarker(int version);
+    static int markerVersion(const QString &marker);
+    static QJsonArray migrateContent(const QJsonArray &content);
     bool loadProjectStructure();
     bool saveProjectStructure();
 
+signals:
+    void saveFinished(bool success);
+
+private slots:
+    void processSaveFinished();
+
 };
 } // namespace Collett
 
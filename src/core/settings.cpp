@@ -27,20 +27,21 @@
 
 #define CNF_EDITOR_AUTO_SAVE "Editor/autoSave"
 
+#define CNF_PROJECT_DURABILITY "Project/durability"
+#define CNF_PROJECT_CACHE_SIZE "Project/cacheSize"
+#define CNF_PROJECT_COLUMNAR   "Project/columnar"
+
 #define CNF_TEXT_FONT_SIZE "TextFormat/fontSize"
 #define CNF_TEXT_TAB_WIDTH "TextFormat/tabWidth"
 
 #include <algorithm>
 
-#include <QFont>
 #include <QList>
 #include <QSize>
 #include <QVariant>
 #include <QSettings>
 #include <QVariantList>
-#include <QTextCharFormat>
 #include <QCoreApplication>
-#include <QTextBlockFormat>
 
 namespace Collett {
 
@@ -110,12 +111,19 @@ CollettSettings::CollettSettings() {
 
     m_editorAutoSave = std::max(settings.value(CNF_EDITOR_AUTO_SAVE, 30).toInt(), 5);
 
+    // Project Settings
+    // ----------------
+
+    m_projectDurability = std::clamp(settings.value(CNF_PROJECT_DURABILITY, 1).toInt(), 0, 2);
+    m_projectCacheSize = std::max(settings.value(CNF_PROJECT_CACHE_SIZE, 64).toInt(), 1);
+    m_projectColumnar = settings.value(CNF_PROJECT_COLUMNAR, false).toBool();
+
     // Text Format
     // -----------
 
     m_textFontSize = std::max(settings.value(CNF_TEXT_FONT_SIZE, (qreal)13.0).toReal(), 5.0);
     m_textTabWidth = std::max(settings.value(CNF_TEXT_TAB_WIDTH, (qreal)40.0).toReal(), 0.0);
-    recalculateTextFormats();
+    m_textStyles.update(m_textFontSize, m_textTabWidth);
 
 }
 
@@ -137,7 +145,12 @@ void CollettSettings::flushSettings() {
 
     settings.setValue(CNF_EDITOR_AUTO_SAVE, m_editorAutoSave);
 
+    settings.setValue(CNF_PROJECT_DURABILITY, m_projectDurability);
+    settings.setValue(CNF_PROJECT_CACHE_SIZE, m_projectCacheSize);
+    settings.setValue(CNF_PROJECT_COLUMNAR, m_projectColumnar);
+
     settings.setValue(CNF_TEXT_FONT_SIZE, m_textFontSize);
+    settings.setValue(CNF_TEXT_TAB_WIDTH, m_textTabWidth);
 
     qDebug() << "CollettSettings values saved";
 
@@ -161,9 +174,28 @@ void CollettSettings::setEditorAutoSave(const int interval) {
     m_editorAutoSave = interval;
 }
 
+void CollettSettings::setProjectDurability(const int level) {
+    m_projectDurability = std::clamp(level, 0, 2);
+}
+
+void CollettSettings::setProjectCacheSize(const int size) {
+    m_projectCacheSize = std::max(size, 1);
+}
+
+void CollettSettings::setProjectColumnar(const bool state) {
+    m_projectColumnar = state;
+}
+
 void CollettSettings::setTextFontSize(const qreal size) {
-    m_textFontSize = size;
-    recalculateTextFormats();
+    m_textFontSize = std::max(size, 5.0);
+    m_textStyles.update(m_textFontSize, m_textTabWidth);
+    emit textStylesChanged();
+}
+
+void CollettSettings::setTextTabWidth(const qreal width) {
+    m_textTabWidth = std::max(width, 0.0);
+    m_textStyles.update(m_textFontSize, m_textTabWidth);
+    emit textStylesChanged();
 }
 
 /**
@@ -183,102 +215,37 @@ int CollettSettings::editorAutoSave() const {
     return m_editorAutoSave;
 }
 
-CollettSettings::TextFormat CollettSettings::textFormat() const {
-    return m_textFormat;
+int CollettSettings::projectDurability() const {
+    return m_projectDurability;
 }
 
-/**
- * Internal Functions
- * ==================
+/**!
+ * @brief The memory budget of the project document cache in MiB.
  */
+int CollettSettings::projectCacheSize() const {
+    return m_projectCacheSize;
+}
 
-void CollettSettings::recalculateTextFormats() {
-
-    // Text Formats
-
-    QTextCharFormat  defaultCharFmt;
-    QTextBlockFormat defaultBlockFmt;
-
-    // Default Values
-
-    qreal defaultLineHeight = 1.15;
-    qreal defaultTopMargin = 0.5 * m_textFontSize;
-    qreal defaultBottomMargin = 0.5 * m_textFontSize;
-
-    qreal header1FontSize = 2.0*m_textFontSize;
-    qreal header2FontSize = 1.7*m_textFontSize;
-    qreal header3FontSize = 1.4*m_textFontSize;
-    qreal header4FontSize = 1.2*m_textFontSize;
-
-    qreal headerBottomMargin = 0.7 * m_textFontSize;
-
-    // Text Format Values
-
-    m_textFormat.fontSize = m_textFontSize;
-    m_textFormat.tabWidth = m_textTabWidth;
-    m_textFormat.lineHeight = 1.15;
-
-    // Default Text Formats
-
-    defaultBlockFmt.setHeadingLevel(0);
-    defaultBlockFmt.setLineHeight(defaultLineHeight, QTextBlockFormat::SingleHeight);
-    defaultBlockFmt.setTopMargin(defaultTopMargin);
-    defaultBlockFmt.setBottomMargin(defaultBottomMargin);
-    defaultBlockFmt.setTextIndent(0.0);
-    m_textFormat.blockDefault = defaultBlockFmt;
-
-    defaultCharFmt.setFontPointSize(m_textFontSize);
-    m_textFormat.charDefault = defaultCharFmt;
-
-    // Paragraph Formats
-
-    m_textFormat.blockParagraph = defaultBlockFmt;
-    m_textFormat.charParagraph = defaultCharFmt;
-
-    // Header 1 Formats
-
-    m_textFormat.blockHeader1 = defaultBlockFmt;
-    m_textFormat.blockHeader1.setHeadingLevel(1);
-    m_textFormat.blockHeader1.setTopMargin(header1FontSize);
-    m_textFormat.blockHeader1.setBottomMargin(headerBottomMargin);
-
-    m_textFormat.charHeader1 = defaultCharFmt;
-    m_textFormat.charHeader1.setFontPointSize(header1FontSize);
-    m_textFormat.charHeader1.setFontWeight(QFont::Bold);
-
-    // Header 2 Formats
-
-    m_textFormat.blockHeader2 = defaultBlockFmt;
-    m_textFormat.blockHeader2.setHeadingLevel(2);
-    m_textFormat.blockHeader2.setTopMargin(header2FontSize);
-    m_textFormat.blockHeader2.setBottomMargin(headerBottomMargin);
-
-    m_textFormat.charHeader2 = defaultCharFmt;
-    m_textFormat.charHeader2.setFontPointSize(header2FontSize);
-    m_textFormat.charHeader2.setFontWeight(QFont::Bold);
-
-    // Header 3 Formats
-
-    m_textFormat.blockHeader3 = defaultBlockFmt;
-    m_textFormat.blockHeader3.setHeadingLevel(3);
-    m_textFormat.blockHeader3.setTopMargin(header3FontSize);
-    m_textFormat.blockHeader3.setBottomMargin(headerBottomMargin);
-
-    m_textFormat.charHeader3 = defaultCharFmt;
-    m_textFormat.charHeader3.setFontPointSize(header3FontSize);
-    m_textFormat.charHeader3.setFontWeight(QFont::Bold);
-
-    // Header 4 Formats
+/**!
+ * @brief Whether archive projects also write columnar content tables.
+ */
+bool CollettSettings::projectColumnar() const {
+    return m_projectColumnar;
+}
 
-    m_textFormat.blockHeader4 = defaultBlockFmt;
-    m_textFormat.blockHeader4.setHeadingLevel(4);
-    m_textFormat.blockHeader4.setTopMargin(header4FontSize);
-    m_textFormat.blockHeader4.setBottomMargin(headerBottomMargin);
+qreal CollettSettings::textFontSize() const {
+    return m_textFontSize;
+}
 
-    m_textFormat.charHeader4 = defaultCharFmt;
-    m_textFormat.charHeader4.setFontPointSize(header4FontSize);
-    m_textFormat.charHeader4.setFontWeight(QFont::Bold);
+qreal CollettSettings::textTabWidth() const {
+    return m_textTabWidth;
+}
 
+/**!
+ * @brief The shared text styles, rebuilt when the text settings change.
+ */
+const StyleRegistry &CollettSettings::textStyles() const {
+    return m_textStyles;
 }
 
 } // namespace Collett
@@ -23,12 +23,11 @@
 #define COLLETT_SETTINGS_H
 
 #include "collett.h"
+#include "styleregistry.h"
 
 #include <QList>
 #include <QSize>
 #include <QScopedPointer>
-#include <QTextCharFormat>
-#include <QTextBlockFormat>
 
 namespace Collett {
 
@@ -37,24 +36,6 @@ class CollettSettings : public QObject
     Q_OBJECT
 
 public:
-    struct TextFormat {
-        QTextBlockFormat blockDefault;
-        QTextCharFormat  charDefault;
-        QTextBlockFormat blockParagraph;
-        QTextCharFormat  charParagraph;
-        QTextBlockFormat blockHeader1;
-        QTextCharFormat  charHeader1;
-        QTextBlockFormat blockHeader2;
-        QTextCharFormat  charHeader2;
-        QTextBlockFormat blockHeader3;
-        QTextCharFormat  charHeader3;
-        QTextBlockFormat blockHeader4;
-        QTextCharFormat  charHeader4;
-        qreal fontSize;
-        qreal tabWidth;
-        qreal lineHeight;
-    };
-
     static CollettSettings *instance();
     static void destroy();
 
@@ -68,6 +49,9 @@ public:
     void setMainWindowSize(const QSize size);
     void setMainSplitSizes(const QList<int> &sizes);
     void setEditorAutoSave(const int interval);
+    void setProjectDurability(const int level);
+    void setProjectCacheSize(const int size);
+    void setProjectColumnar(const bool state);
     void setTextFontSize(const qreal size);
     void setTextTabWidth(const qreal width);
 
@@ -76,7 +60,16 @@ public:
     QSize      mainWindowSize() const;
     QList<int> mainSplitSizes() const;
     int        editorAutoSave() const;
-    TextFormat textFormat() const;
+    int        projectDurability() const;
+    int        projectCacheSize() const;
+    bool       projectColumnar() const;
+    qreal      textFontSize() const;
+    qreal      textTabWidth() const;
+
+    const StyleRegistry &textStyles() const;
+
+signals:
+    void textStylesChanged();
 
 private:
     static CollettSettings *staticInstance;
@@ -90,15 +83,17 @@ private:
 
     int m_editorAutoSave;
 
-    // Text Format
+    // Project
 
-    qreal      m_textFontSize;
-    qreal      m_textTabWidth;
-    TextFormat m_textFormat;
+    int m_projectDurability;
+    int m_projectCacheSize;
+    bool m_projectColumnar;
 
-    // Internal Functions
+    // Text Format
 
-    void recalculateTextFormats();
+    qreal         m_textFontSize;
+    qreal         m_textTabWidth;
+    StyleRegistry m_textStyles;
 
 };
 } // namespace Collett
@@ -20,27 +20,58 @@
 */
 
 #include "storage.h"
+#include "contenttable.h"
+#include "formatcodec.h"
+#include "jsonwriter.h"
 
+#define COL_ARCHIVE_INDEX   "project.json"
+#define COL_ARCHIVE_CONTENT "content"
+#define COL_ARCHIVE_JOURNAL "journal.jsonl"
+
+#include <algorithm>
+
+#include <QBuffer>
 #include <QDir>
+#include <QSet>
 #include <QFile>
 #include <QFileInfo>
+#include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonParseError>
+#include <QMutexLocker>
+#include <QCborMap>
+#include <QCborValue>
+#include <QCborStreamReader>
+#include <QCborStreamWriter>
+#include <QSaveFile>
+#include <QFileDevice>
+#include <QCryptographicHash>
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 namespace Collett {
 
 Storage::Storage(const QString &path, bool compact) : m_compactJson(compact)
 {
     QFileInfo pathInfo(path);
-    if (pathInfo.suffix().toLower() == "fcollett") {
+    QString suffix = pathInfo.suffix().toLower();
+    bool isWritable = pathInfo.exists() ? pathInfo.isWritable() : QFileInfo(pathInfo.absolutePath()).isWritable();
+    if (suffix == "fcollett") {
+        m_saveMode = Storage::Flat;
+        m_isValid = isWritable;
+    } else if (suffix == "bcollett") {
         m_saveMode = Storage::Flat;
-        m_isValid = pathInfo.isWritable();
-    } else if (pathInfo.suffix().toLower() == "collett") {
+        m_encoding = Storage::Cbor;
+        m_isValid = isWritable;
+    } else if (suffix == "collett") {
         m_saveMode = Storage::Archive;
-        m_isValid = pathInfo.isWritable();
+        m_isValid = isWritable;
     } else {
-        m_lastError = "Archive storage is not yet implemented";
+        m_lastError = tr("Unknown project file type: %1").arg(path);
         m_saveMode = Storage::Archive;
         m_isValid = false;
         qWarning() << "Invalid path:" << path;
@@ -60,16 +91,24 @@ Storage::~Storage() {
 
 /**
  * Class Methods
+ *
+ * The shared state is guarded by a mutex, so that a project can be written
+ * on a worker thread while entries are read on the GUI thread. Writes only
+ * hold it briefly to update the entry index and the last error, while the
+ * file I/O of a write is serialised by a separate mutex.
  */
 
 bool Storage::readProject(QJsonObject &fileData) {
 
+    QMutexLocker locker(&m_mutex);
     if (!m_isValid) {
         return false;
     }
 
     if (m_saveMode == Mode::Flat) {
-        return this->readJson(m_rootPath.path(), fileData);
+        return this->readFile(m_rootPath.path(), fileData);
+    } else if (m_saveMode == Mode::Archive) {
+        return this->readArchive(fileData);
     }
 
     return false;
@@ -77,21 +116,79 @@ bool Storage::readProject(QJsonObject &fileData) {
 
 bool Storage::writeProject(const QJsonObject &fileData) {
 
+    QMutexLocker locker(&m_writeMutex);
     if (!m_isValid) {
         return false;
     }
 
     if (m_saveMode == Mode::Flat) {
-        return this->writeJson(m_rootPath.path(), fileData, false);
+        return this->writeFile(m_rootPath.path(), fileData);
+    } else if (m_saveMode == Mode::Archive) {
+        return this->writeArchive(fileData);
     }
 
     return false;
 }
 
+/**!
+ * @brief Read the content of a single archive entry.
+ *
+ * @param handle  the handle of the entry, as listed in the archive index.
+ * @param content the array to receive the content blocks.
+ * @return true if the entry was read successfully.
+ */
+bool Storage::readEntry(const QString &handle, QJsonArray &content) {
+
+    QMutexLocker locker(&m_mutex);
+    if (!m_isValid || m_saveMode != Mode::Archive) {
+        return false;
+    }
+
+    QJsonObject jEntry;
+    QString entryPath = m_rootPath.filePath(QString(COL_ARCHIVE_CONTENT "/%1.json").arg(handle));
+    if (!this->readFile(entryPath, jEntry)) {
+        return false;
+    }
+
+    content = jEntry.value(QLatin1String("x:content")).toArray();
+
+    return true;
+}
+
 bool Storage::isValid() {
     return m_isValid;
 }
 
+/**!
+ * @brief Set how carefully project files are written to disk.
+ *
+ * @param level Direct writes in place, Atomic writes a temporary file that is
+ *              synced and renamed over the target, and Durable also syncs the
+ *              folder so that the rename itself survives a power loss.
+ */
+void Storage::setDurability(Durability level) {
+    m_durability = level;
+}
+
+/**!
+ * @brief Set whether archive entries also get a columnar content table.
+ *
+ * The tables are written next to the JSON entries with a .ctab suffix, and
+ * can be memory mapped with ContentTable to read the text without parsing
+ * JSON. They are optional, and the JSON entries remain the primary content.
+ */
+void Storage::setColumnar(bool state) {
+    m_columnar = state;
+}
+
+Storage::Mode Storage::saveMode() const {
+    return m_saveMode;
+}
+
+Storage::Encoding Storage::encoding() const {
+    return m_encoding;
+}
+
 QString Storage::projectPath() const {
     if (m_isValid) {
         return m_rootPath.path();
@@ -101,13 +198,159 @@ QString Storage::projectPath() const {
 }
 
 bool Storage::hasError() {
+    QMutexLocker locker(&m_mutex);
     return !m_lastError.isEmpty();
 }
 
+/**!
+ * @brief Read the project metadata sections without the document.
+ *
+ * For JSON files, the section index is used to parse only the bytes of the
+ * c:meta, c:project and c:settings sections. For CBOR files, the document is
+ * skipped without being decoded. Files without an index are parsed in full.
+ *
+ * @param sections the object to receive the sections.
+ * @return true if the sections were read.
+ */
+bool Storage::peekMeta(QJsonObject &sections) {
+
+    QMutexLocker locker(&m_mutex);
+    if (!m_isValid) {
+        return false;
+    }
+
+    QString filePath = m_rootPath.path();
+    if (m_saveMode == Mode::Archive) {
+        filePath = m_rootPath.filePath(COL_ARCHIVE_INDEX);
+    }
+
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        this->setError(tr("Could not open file: %1").arg(filePath));
+        qWarning() << "Could not open file:" << filePath;
+        return false;
+    }
+
+    bool success = false;
+    {
+        QByteArray data = Storage::mapFile(file);
+        if (Storage::isCborData(data)) {
+            success = Storage::peekCbor(data, sections);
+        } else {
+            success = Storage::peekJson(data, sections);
+        }
+    }
+    file.close();
+
+    if (!success) {
+        QJsonObject fileData;
+        if (!this->readFile(filePath, fileData)) {
+            return false;
+        }
+        for (const QLatin1String &key : Storage::indexedSections()) {
+            if (key != QLatin1String("u:document")) {
+                sections[key] = fileData.value(key);
+            }
+        }
+    }
+
+    return true;
+}
+
+/**!
+ * @brief Memory map the data of a flat JSON project file.
+ *
+ * The data is only valid while the file is open, so the caller keeps the
+ * file open for as long as it uses the data. A file written in place would
+ * change under the mapping, so the storage writes files atomically from
+ * here on, whatever the durability level. Archive projects and CBOR files
+ * have no single JSON content array to stream, and return false without an
+ * error.
+ *
+ * @param file the file to open and map.
+ * @param data the byte array to receive the mapped data.
+ * @return true if the data was mapped.
+ */
+bool Storage::mapContentFile(QFile &file, QByteArray &data) {
+
+    QMutexLocker locker(&m_mutex);
+    if (!m_isValid || m_saveMode == Mode::Archive || m_encoding == Encoding::Cbor) {
+        return false;
+    }
+
+    QString filePath = m_rootPath.path();
+    file.setFileName(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        this->setError(tr("Could not open file: %1").arg(filePath));
+        qWarning() << "Could not open file:" << filePath;
+        return false;
+    }
+
+    data = Storage::mapFile(file);
+    if (Storage::isCborData(data)) {
+        // A JSON project file that holds CBOR data is parsed the slow way
+        data.clear();
+        file.close();
+        return false;
+    }
+    m_isMapped = true;
+
+    return true;
+}
+
+/**!
+ * @brief Get the path of the edit journal for the project.
+ *
+ * Archive projects keep the journal inside the project folder, and flat
+ * projects keep it next to the project file.
+ *
+ * @return the journal path, or an empty string if the storage is invalid.
+ */
+QString Storage::journalPath() const {
+    if (!m_isValid) {
+        return QString();
+    } else if (m_saveMode == Mode::Archive) {
+        return m_rootPath.filePath(COL_ARCHIVE_JOURNAL);
+    } else {
+        return m_rootPath.path() + ".journal";
+    }
+}
+
+/**!
+ * @brief Get the path of the content table of an archive entry.
+ *
+ * @param handle the handle of the entry.
+ * @return the path, or an empty string if the entry has no table.
+ */
+QString Storage::tablePath(const QString &handle) const {
+    if (!m_isValid || m_saveMode != Mode::Archive) {
+        return QString();
+    }
+    QString path = m_rootPath.filePath(QString(COL_ARCHIVE_CONTENT "/%1.ctab").arg(handle));
+    return QFile::exists(path) ? path : QString();
+}
+
+QJsonArray Storage::entries() const {
+    QMutexLocker locker(&m_mutex);
+    return m_entries;
+}
+
 QString Storage::lastError() const {
+    QMutexLocker locker(&m_mutex);
     return m_lastError;
 }
 
+/**!
+ * @brief Record an error message.
+ *
+ * This is used by both reads and writes, so the message is set under the
+ * mutex. The mutex is recursive, as most reads already hold it.
+ */
+void Storage::setError(const QString &message) {
+    QMutexLocker locker(&m_mutex);
+    m_lastError = message;
+}
+
 /**
  * Static Methods
  */
@@ -128,66 +371,652 @@ QString Storage::getJsonString(const QJsonObject &object, const QLatin1String &k
     }
 }
 
+/**!
+ * @brief Check if a content block starts a new archive entry.
+ *
+ * Partition and chapter headings (h1 and h2) start a new entry, so that each
+ * chapter is stored and loaded separately.
+ *
+ * @param block the json object of the block.
+ * @return true if the block is an h1 or h2 heading.
+ */
+bool Storage::isSectionBreak(const QJsonObject &block) {
+    int hLevel = FormatCodec::headingLevel(FormatCodec::decodeBlockValue(block.value(QLatin1String("u:fmt"))));
+    return hLevel == 1 || hLevel == 2;
+}
+
+/**!
+ * @brief The sections that are listed in the section index of a JSON file.
+ */
+QList<QLatin1String> Storage::indexedSections() {
+    return QList<QLatin1String>() << QLatin1String("c:meta") << QLatin1String("c:project")
+        << QLatin1String("c:settings") << QLatin1String("u:document");
+}
+
+/**!
+ * @brief Format a byte span as a fixed width section index value.
+ */
+QString Storage::formatSpan(qint64 offset, qint64 length) {
+    return QString("%1+%2").arg(offset, 12, 10, QChar('0')).arg(length, 12, 10, QChar('0'));
+}
+
+/**!
+ * @brief Check if file data starts with the self describing CBOR tag.
+ *
+ * @param data the file data.
+ * @return true if the data is CBOR encoded.
+ */
+bool Storage::isCborData(const QByteArray &data) {
+    return data.startsWith(QByteArrayView("\xd9\xd9\xf7", 3));
+}
+
+/**!
+ * @brief Get the content of an open file without copying it.
+ *
+ * The file is memory mapped and the returned byte array refers directly to
+ * the mapped region, so it is only valid while the file is open. If the file
+ * cannot be mapped, its content is read into memory instead.
+ *
+ * @param file the file, open for reading.
+ * @return the file content.
+ */
+QByteArray Storage::mapFile(QFile &file) {
+    qint64 size = file.size();
+    uchar *data = size > 0 ? file.map(0, size) : nullptr;
+    if (data != nullptr) {
+        return QByteArray::fromRawData(reinterpret_cast<const char *>(data), size);
+    } else {
+        return file.readAll();
+    }
+}
+
 /**
  * Private Methods
  */
 
-bool Storage::readJson(const QString &filePath, QJsonObject &fileData) {
+/**!
+ * @brief Parse the metadata sections of JSON data using the section index.
+ *
+ * @param data     the file data.
+ * @param sections the object to receive the sections.
+ * @return false if the data has no valid section index.
+ */
+bool Storage::peekJson(const QByteArray &data, QJsonObject &sections) {
+
+    // The index is written right after c:format, so it is near the start
+    QByteArray head = QByteArray::fromRawData(data.constData(), std::min<qsizetype>(data.size(), 1024));
+    qsizetype indexKey = head.indexOf("\"c:index\"");
+    qsizetype indexStart = indexKey < 0 ? -1 : head.indexOf('{', indexKey);
+    qsizetype indexEnd = indexStart < 0 ? -1 : head.indexOf('}', indexStart);
+    if (indexEnd < 0) {
+        return false;
+    }
+
+    QJsonObject jIndex = QJsonDocument::fromJson(data.sliced(indexStart, indexEnd - indexStart + 1)).object();
+    for (const QLatin1String &key : Storage::indexedSections()) {
+        if (key == QLatin1String("u:document")) {
+            continue;
+        }
+        QStringList span = jIndex.value(key).toString().split('+');
+        qint64 offset = span.size() == 2 ? span.at(0).toLongLong() : 0;
+        qint64 length = span.size() == 2 ? span.at(1).toLongLong() : 0;
+        if (offset <= 0 || length <= 0 || offset + length > data.size()) {
+            return false;
+        }
+        QJsonDocument json = QJsonDocument::fromJson(
+            QByteArray::fromRawData(data.constData() + offset, length)
+        );
+        if (!json.isObject()) {
+            return false;
+        }
+        sections[key] = json.object();
+    }
+
+    return true;
+}
+
+/**!
+ * @brief Parse the metadata sections of CBOR data, skipping the document.
+ *
+ * @param data     the file data.
+ * @param sections the object to receive the sections.
+ * @return false if the data could not be parsed.
+ */
+bool Storage::peekCbor(const QByteArray &data, QJsonObject &sections) {
+
+    QCborStreamReader reader(data);
+    if (reader.isTag() && reader.toTag() == QCborTag(QCborKnownTags::Signature)) {
+        reader.next();
+    }
+    if (!reader.isMap() || !reader.enterContainer()) {
+        return false;
+    }
+
+    while (reader.lastError() == QCborError::NoError && reader.hasNext()) {
+        QString key;
+        if (!reader.isString()) {
+            return false;
+        }
+        auto chunk = reader.readString();
+        while (chunk.status == QCborStreamReader::Ok) {
+            key += chunk.data;
+            chunk = reader.readString();
+        }
+        if (chunk.status == QCborStreamReader::Error) {
+            return false;
+        }
+
+        if (key.startsWith(QLatin1String("c:"))) {
+            sections[key] = QCborValue::fromCbor(reader).toJsonValue();
+        } else {
+            reader.next();
+        }
+    }
+    sections.remove(QLatin1String("c:format"));
+
+    return reader.lastError() == QCborError::NoError;
+}
+
+/**!
+ * @brief Read a project file in either encoding.
+ *
+ * The encoding is detected from the content. CBOR files start with the self
+ * describing CBOR tag, anything else is parsed as JSON.
+ *
+ * @param filePath the path of the file.
+ * @param fileData the object to receive the file data.
+ * @return true if the file was read successfully.
+ */
+bool Storage::readFile(const QString &filePath, QJsonObject &fileData) {
 
     QFile file(filePath);
     if (!file.open(QIODevice::ReadOnly)) {
-        m_lastError = tr("Could not open file: %1").arg(filePath);
+        this->setError(tr("Could not open file: %1").arg(filePath));
         qWarning() << "Could not open file:" << filePath;
         return false;
     }
 
-    QJsonParseError *error = new QJsonParseError();
-    QJsonDocument json = QJsonDocument::fromJson(file.readAll(), error);
-    if (error->error != QJsonParseError::NoError) {
-        m_lastError = tr("Could not parse file: %1").arg(filePath);
+    bool success = false;
+    {
+        QByteArray data = Storage::mapFile(file);
+        if (Storage::isCborData(data)) {
+            success = this->parseCbor(data, filePath, fileData);
+        } else {
+            success = this->parseJson(data, filePath, fileData);
+        }
+    }
+    file.close();
+
+    if (success) {
+        qDebug() << "Read:" << filePath;
+    }
+
+    return success;
+}
+
+/**!
+ * @brief Write a project file in the encoding of the storage.
+ *
+ * @param filePath the path of the file.
+ * @param fileData the project data.
+ * @return true if the file was written successfully.
+ */
+bool Storage::writeFile(const QString &filePath, const QJsonObject &fileData) {
+    if (m_encoding == Encoding::Cbor) {
+        return this->writeCbor(filePath, fileData);
+    } else {
+        return this->writeIndexedJson(filePath, fileData);
+    }
+}
+
+bool Storage::parseJson(const QByteArray &data, const QString &filePath, QJsonObject &fileData) {
+
+    QJsonParseError error;
+    QJsonDocument json = QJsonDocument::fromJson(data, &error);
+    if (error.error != QJsonParseError::NoError) {
+        this->setError(tr("Could not parse file: %1").arg(filePath));
         qWarning() << "Could not parse file:" << filePath;
-        qWarning() << error->errorString();
+        qWarning() << error.errorString();
         return false;
     }
 
     if (!json.isObject()) {
-        m_lastError = tr("Unexpected content of file: %1").arg(filePath);
+        this->setError(tr("Unexpected content of file: %1").arg(filePath));
         qWarning() << "Unexpected content of file:" << filePath;
         return false;
     }
 
     fileData = json.object();
-    qDebug() << "Read:" << filePath;
+
+    return true;
+}
+
+bool Storage::parseCbor(const QByteArray &data, const QString &filePath, QJsonObject &fileData) {
+
+    QCborStreamReader reader(data);
+    QCborValue cbor = QCborValue::fromCbor(reader);
+    if (reader.lastError() != QCborError::NoError) {
+        this->setError(tr("Could not parse file: %1").arg(filePath));
+        qWarning() << "Could not parse file:" << filePath;
+        qWarning() << reader.lastError().toString();
+        return false;
+    }
+
+    if (cbor.isTag() && cbor.tag() == QCborTag(QCborKnownTags::Signature)) {
+        cbor = cbor.taggedValue();
+    }
+    if (!cbor.isMap()) {
+        this->setError(tr("Unexpected content of file: %1").arg(filePath));
+        qWarning() << "Unexpected content of file:" << filePath;
+        return false;
+    }
+
+    fileData = cbor.toMap().toJsonObject();
 
     return true;
 }
 
 bool Storage::writeJson(const QString &filePath, const QJsonObject &fileData, bool compact) {
 
-    QFile file(filePath);
-    if (!file.open(QIODevice::WriteOnly)) {
-        m_lastError = tr("Could not open file: %1").arg(filePath);
-        qWarning() << "Could not open file:" << filePath;
+    std::unique_ptr<QFileDevice> file = this->openFile(filePath);
+    if (!file) {
+        return false;
+    }
+
+    JsonWriter writer(file.get(), m_compactJson || compact);
+    if (!writer.writeDocument(fileData)) {
+        this->abortFile(file.get(), filePath);
+        return false;
+    }
+
+    return this->commitFile(file.get(), filePath);
+}
+
+/**!
+ * @brief Write a JSON project file with a section index.
+ *
+ * The root object gets a "c:index" member holding the byte offset and length
+ * of each section, so that peekMeta() can parse the small sections without
+ * touching the document. The key sorts before the sections, so it is near
+ * the start of the file. It is first written with zero-padded placeholder
+ * values of fixed width, and then overwritten in place with the real values
+ * once the sections have been written.
+ *
+ * @param filePath the path of the file.
+ * @param fileData the project data.
+ * @return true if the file was written successfully.
+ */
+bool Storage::writeIndexedJson(const QString &filePath, const QJsonObject &fileData) {
+
+    std::unique_ptr<QFileDevice> file = this->openFile(filePath);
+    if (!file) {
+        return false;
+    }
+
+    QJsonObject jIndex;
+    for (const QLatin1String &key : Storage::indexedSections()) {
+        jIndex[key] = Storage::formatSpan(0, 0);
+    }
+    QJsonObject jData = fileData;
+    jData[QLatin1String("c:index")] = jIndex;
+
+    JsonWriter writer(file.get(), m_compactJson);
+    writer.setTrackMembers(true);
+    if (!writer.writeDocument(jData)) {
+        this->abortFile(file.get(), filePath);
+        return false;
+    }
+
+    for (const QLatin1String &key : Storage::indexedSections()) {
+        QPair<qint64, qint64> span = writer.memberSpan(key);
+        jIndex[key] = Storage::formatSpan(span.first, span.second);
+    }
+
+    QPair<qint64, qint64> indexSpan = writer.memberSpan("c:index");
+    QByteArray indexData = JsonWriter::toBytes(jIndex, 1, m_compactJson);
+    if (indexData.size() == indexSpan.second && file->seek(indexSpan.first)) {
+        if (file->write(indexData) != indexData.size()) {
+            this->abortFile(file.get(), filePath);
+            return false;
+        }
+    } else {
+        qWarning() << "Could not write section index:" << filePath;
+    }
+
+    return this->commitFile(file.get(), filePath);
+}
+
+/**!
+ * @brief Write a CBOR project file.
+ *
+ * The file starts with the self describing CBOR tag, which is also used to
+ * detect the encoding when the file is read.
+ *
+ * @param filePath the path of the file.
+ * @param fileData the project data.
+ * @return true if the file was written successfully.
+ */
+bool Storage::writeCbor(const QString &filePath, const QJsonObject &fileData) {
+
+    std::unique_ptr<QFileDevice> file = this->openFile(filePath);
+    if (!file) {
         return false;
     }
 
-    QJsonDocument doc(fileData);
-    QByteArray jsonData = doc.toJson(m_compactJson ? QJsonDocument::Compact : QJsonDocument::Indented);
+    QCborStreamWriter writer(file.get());
+    writer.append(QCborKnownTags::Signature);
+    QCborValue(QCborMap::fromJsonObject(fileData)).toCbor(writer);
 
-    if (compact) {
-        file.write(jsonData);
+    return this->commitFile(file.get(), filePath);
+}
+
+/**!
+ * @brief Open a file for writing according to the durability level.
+ *
+ * For the Atomic and Durable levels, the data is written to a temporary file
+ * that only replaces the target file when committed. So is the data of a
+ * storage with a mapped project file.
+ *
+ * @param filePath the path of the file to write.
+ * @return the open file device, or nullptr on failure.
+ */
+std::unique_ptr<QFileDevice> Storage::openFile(const QString &filePath) {
+
+    std::unique_ptr<QFileDevice> file;
+    if (m_durability == Durability::Direct && !m_isMapped) {
+        file.reset(new QFile(filePath));
     } else {
-        for (QByteArray line: jsonData.split('\n')) {
-            QByteArray trimmed = line.trimmed();
-            if (trimmed.length() > 0) {
-                file.write(QByteArray((line.length() - trimmed.length())/4, '\t') + trimmed + '\n');
+        file.reset(new QSaveFile(filePath));
+    }
+
+    if (!file->open(QIODevice::WriteOnly)) {
+        this->setError(tr("Could not open file: %1").arg(filePath));
+        qWarning() << "Could not open file:" << filePath;
+        return nullptr;
+    }
+
+    return file;
+}
+
+/**!
+ * @brief Finish writing a file opened with openFile().
+ *
+ * A temporary file is flushed to disk and renamed over the target file. If
+ * any write failed, the target file is left untouched.
+ *
+ * @param file     the file device to commit.
+ * @param filePath the path of the file, for error reporting.
+ * @return true if the file was written successfully.
+ */
+bool Storage::commitFile(QFileDevice *file, const QString &filePath) {
+
+    bool success = file->error() == QFileDevice::NoError;
+    if (QSaveFile *saveFile = qobject_cast<QSaveFile*>(file)) {
+        success = saveFile->commit();
+    } else {
+        file->close();
+        success = success && file->error() == QFileDevice::NoError;
+    }
+
+    if (!success) {
+        this->setError(tr("Could not write file: %1").arg(filePath));
+        qWarning() << "Could not write file:" << filePath;
+        qWarning() << file->errorString();
+        return false;
+    }
+
+    if (m_durability == Durability::Durable) {
+        Storage::syncFolder(QFileInfo(filePath).absolutePath());
+    }
+    qDebug() << "Wrote:" << filePath;
+
+    return true;
+}
+
+/**!
+ * @brief Give up on a file opened with openFile() after a failed write.
+ *
+ * A temporary file is discarded, so the target file is left untouched. A
+ * file written in place is closed as is, and the project must be saved
+ * again to repair it.
+ *
+ * @param file     the file device to abort.
+ * @param filePath the path of the file, for error reporting.
+ */
+void Storage::abortFile(QFileDevice *file, const QString &filePath) {
+
+    this->setError(tr("Could not write file: %1").arg(filePath));
+    qWarning() << "Could not write file:" << filePath;
+    qWarning() << file->errorString();
+
+    if (QSaveFile *saveFile = qobject_cast<QSaveFile*>(file)) {
+        saveFile->cancelWriting();
+    }
+    file->close();
+}
+
+/**!
+ * @brief Flush a folder's entries to disk.
+ *
+ * This makes a rename into the folder persistent, and is only needed on
+ * platforms where renames are not flushed with the file itself.
+ *
+ * @param path the path of the folder.
+ */
+void Storage::syncFolder(const QString &path) {
+#ifdef Q_OS_UNIX
+    int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_DIRECTORY);
+    if (fd >= 0) {
+        ::fsync(fd);
+        ::close(fd);
+    }
+#else
+    Q_UNUSED(path);
+#endif
+}
+
+/**!
+ * @brief Read the index of an archive project.
+ *
+ * Only the index file is read. The document section lists the content entries
+ * under "c:entries", and each entry is read on demand with readEntry().
+ *
+ * @param fileData the object to receive the index data.
+ * @return true if the index was read successfully.
+ */
+bool Storage::readArchive(QJsonObject &fileData) {
+
+    if (!this->readFile(m_rootPath.filePath(COL_ARCHIVE_INDEX), fileData)) {
+        return false;
+    }
+
+    QJsonObject jDocument = fileData.value(QLatin1String("u:document")).toObject();
+    m_entries = jDocument.value(QLatin1String("c:entries")).toArray();
+
+    return true;
+}
+
+/**!
+ * @brief Write an archive project.
+ *
+ * This runs without holding the state mutex, except when the new entry
+ * index is put in place.
+ *
+ * If the document section holds the content, it is split into one entry per
+ * chapter and each entry is written to the content folder. Entries are named
+ * by the hash of their content, so unchanged chapters are not rewritten. If
+ * the document section has no content, only the index is updated. Entries no
+ * longer referenced by the index are removed afterwards.
+ *
+ * @param fileData the project data.
+ * @return true if the project was written successfully.
+ */
+bool Storage::writeArchive(const QJsonObject &fileData) {
+
+    if (!m_rootPath.mkpath(COL_ARCHIVE_CONTENT)) {
+        this->setError(tr("Could not create folder: %1").arg(m_rootPath.filePath(COL_ARCHIVE_CONTENT)));
+        qWarning() << "Could not create folder:" << m_rootPath.filePath(COL_ARCHIVE_CONTENT);
+        return false;
+    }
+
+    QJsonArray jEntries;
+    QJsonObject jDocument = fileData.value(QLatin1String("u:document")).toObject();
+    if (jDocument.contains(QLatin1String("x:content"))) {
+        QJsonArray jSection;
+        for (const QJsonValue &jBlock : jDocument.value(QLatin1String("x:content")).toArray()) {
+            if (!jSection.isEmpty() && Storage::isSectionBreak(jBlock.toObject())) {
+                if (!this->writeEntry(jSection, jEntries)) {
+                    return false;
+                }
+                jSection = QJsonArray();
             }
+            jSection.append(jBlock);
         }
+        if (!jSection.isEmpty() && !this->writeEntry(jSection, jEntries)) {
+            return false;
+        }
+        jDocument.remove(QLatin1String("x:content"));
+    } else {
+        jEntries = this->entries();
     }
-    file.close();
-    qDebug() << "Wrote:" << filePath;
+    jDocument[QLatin1String("c:entries")] = jEntries;
+
+    QJsonObject jIndex = fileData;
+    jIndex[QLatin1String("u:document")] = jDocument;
+    if (!this->writeJson(m_rootPath.filePath(COL_ARCHIVE_INDEX), jIndex, false)) {
+        return false;
+    }
+
+    // Readers look up entries by the index, so the old entries are only
+    // removed together with the switch to the new index
+    QMutexLocker locker(&m_mutex);
+    m_entries = jEntries;
+    this->purgeEntries();
+
+    return true;
+}
+
+/**!
+ * @brief Write a single archive entry, unless it already exists.
+ *
+ * Entries are named by the hash of their content, but a file with the right
+ * name may still be torn by a crash during a direct write, or by a write
+ * that failed. An existing file is therefore only kept if it holds exactly
+ * the data that would be written, and is rewritten otherwise. The same goes
+ * for the content table of the entry.
+ *
+ * @param content the content blocks of the entry.
+ * @param entries the index array to append the entry record to.
+ * @return true if the entry exists or was written successfully.
+ */
+bool Storage::writeEntry(const QJsonArray &content, QJsonArray &entries) {
+
+    QByteArray hashData = QJsonDocument(content).toJson(QJsonDocument::Compact);
+    QString handle = QString::fromLatin1(
+        QCryptographicHash::hash(hashData, QCryptographicHash::Sha1).toHex().left(16)
+    );
+
+    QJsonObject jEntry;
+    jEntry[QLatin1String("x:content")] = content;
+
+    QByteArray entryData;
+    QBuffer entryBuffer(&entryData);
+    entryBuffer.open(QIODevice::WriteOnly);
+    JsonWriter writer(&entryBuffer, m_compactJson);
+    writer.writeDocument(jEntry);
+    entryBuffer.close();
+
+    QString entryPath = m_rootPath.filePath(QString(COL_ARCHIVE_CONTENT "/%1.json").arg(handle));
+    if (!Storage::hasFileData(entryPath, entryData) && !this->writeData(entryPath, entryData)) {
+        return false;
+    }
+
+    if (m_columnar) {
+        QString tablePath = m_rootPath.filePath(QString(COL_ARCHIVE_CONTENT "/%1.ctab").arg(handle));
+        QByteArray tableData = ContentTable::encode(content);
+        if (tableData.isEmpty()) {
+            this->setError(tr("Could not encode content table: %1").arg(tablePath));
+            return false;
+        }
+        if (!Storage::hasFileData(tablePath, tableData) && !this->writeData(tablePath, tableData)) {
+            return false;
+        }
+    }
+
+    QString title;
+    QJsonObject jFirst = content.first().toObject();
+    if (Storage::isSectionBreak(jFirst)) {
+        title = Storage::getJsonString(jFirst, QLatin1String("u:txt"), "").section('|', 1);
+    }
+
+    QJsonObject jRecord;
+    jRecord[QLatin1String("m:handle")] = handle;
+    jRecord[QLatin1String("m:blocks")] = content.size();
+    jRecord[QLatin1String("u:title")] = title;
+    entries.append(jRecord);
 
     return true;
 }
 
+/**!
+ * @brief Write a block of data to a file.
+ *
+ * @param filePath the path of the file.
+ * @param data     the data to write.
+ * @return true if the file was written.
+ */
+bool Storage::writeData(const QString &filePath, const QByteArray &data) {
+
+    std::unique_ptr<QFileDevice> file = this->openFile(filePath);
+    if (!file) {
+        return false;
+    }
+
+    if (file->write(data) != data.size()) {
+        this->abortFile(file.get(), filePath);
+        return false;
+    }
+
+    return this->commitFile(file.get(), filePath);
+}
+
+/**!
+ * @brief Check if a file holds exactly the given data.
+ *
+ * The size is compared first, so a truncated file is caught without reading
+ * it.
+ *
+ * @param filePath the path of the file.
+ * @param data     the expected data.
+ * @return true if the file exists and holds the data.
+ */
+bool Storage::hasFileData(const QString &filePath, const QByteArray &data) {
+
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly) || file.size() != data.size()) {
+        return false;
+    }
+
+    return Storage::mapFile(file) == data;
+}
+
+/**!
+ * @brief Remove content entries that are not in the archive index.
+ */
+void Storage::purgeEntries() {
+
+    QSet<QString> handles;
+    for (const QJsonValue &jEntry : m_entries) {
+        handles.insert(jEntry.toObject().value(QLatin1String("m:handle")).toString());
+    }
+
+    QDir contentDir(m_rootPath.filePath(COL_ARCHIVE_CONTENT));
+    for (const QFileInfo &entryInfo : contentDir.entryInfoList(QStringList() << "*.json" << "*.ctab", QDir::Files)) {
+        if (!handles.contains(entryInfo.completeBaseName())) {
+            qDebug() << "Removing:" << entryInfo.filePath();
+            QFile::remove(entryInfo.filePath());
+        }
+    }
+}
+
 } // namespace Collett
@@ -24,8 +24,17 @@
 
 #include "collett.h"
 
+#include <atomic>
+#include <memory>
+
 #include <QDir>
+#include <QFile>
+#include <QFileDevice>
+#include <QList>
+#include <QJsonArray>
 #include <QJsonObject>
+#include <QMutex>
+#include <QRecursiveMutex>
 
 namespace Collett {
 
@@ -35,6 +44,8 @@ class Storage : public QObject
 
 public:
     enum Mode{Flat, Archive};
+    enum Encoding{Json, Cbor};
+    enum Durability{Direct, Atomic, Durable};
 
     explicit Storage(const QString &path, bool compact=false);
     ~Storage();
@@ -43,23 +54,67 @@ public:
 
     bool readProject(QJsonObject &fileData);
     bool writeProject(const QJsonObject &fileData);
+    bool readEntry(const QString &handle, QJsonArray &content);
+    bool peekMeta(QJsonObject &sections);
+    bool mapContentFile(QFile &file, QByteArray &data);
+
+    void setDurability(Durability level);
+    void setColumnar(bool state);
 
     bool isValid();
+    Mode saveMode() const;
+    Encoding encoding() const;
     QString projectPath() const;
+    QString journalPath() const;
+    QJsonArray entries() const;
+    QString tablePath(const QString &handle) const;
     bool hasError();
     QString lastError() const;
 
     // Static Methods
 
     static QString getJsonString(const QJsonObject &object, const QLatin1String &key, QString def);
+    static bool isSectionBreak(const QJsonObject &block);
+    static QList<QLatin1String> indexedSections();
+    static QString formatSpan(qint64 offset, qint64 length);
+    static bool isCborData(const QByteArray &data);
+    static QByteArray mapFile(QFile &file);
 
 private:
-    bool readJson(const QString &filePath, QJsonObject &fileData);
+    bool readFile(const QString &filePath, QJsonObject &fileData);
+    bool writeFile(const QString &filePath, const QJsonObject &fileData);
+    bool parseJson(const QByteArray &data, const QString &filePath, QJsonObject &fileData);
+    bool parseCbor(const QByteArray &data, const QString &filePath, QJsonObject &fileData);
     bool writeJson(const QString &filePath, const QJsonObject &fileData, bool compact);
+    bool writeIndexedJson(const QString &filePath, const QJsonObject &fileData);
+    bool writeCbor(const QString &filePath, const QJsonObject &fileData);
+
+    void setError(const QString &message);
+
+    std::unique_ptr<QFileDevice> openFile(const QString &filePath);
+    bool commitFile(QFileDevice *file, const QString &filePath);
+    void abortFile(QFileDevice *file, const QString &filePath);
+    static void syncFolder(const QString &path);
+
+    bool readArchive(QJsonObject &fileData);
+    bool writeArchive(const QJsonObject &fileData);
+    bool writeEntry(const QJsonArray &content, QJsonArray &entries);
+    bool writeData(const QString &filePath, const QByteArray &data);
+    void purgeEntries();
+
+    static bool peekJson(const QByteArray &data, QJsonObject &sections);
+    static bool peekCbor(const QByteArray &data, QJsonObject &sections);
+    static bool hasFileData(const QString &filePath, const QByteArray &data);
 
     QDir m_rootPath;
     Mode m_saveMode;
+    Encoding m_encoding = Encoding::Json;
     bool m_compactJson;
+    Durability m_durability = Durability::Atomic;
+    bool m_columnar = false;
+    std::atomic<bool> m_isMapped{false};
+
+    QJsonArray m_entries;
 
     QString m_collettVersion = "";
     QString m_projectVersion = "";
@@ -67,6 +122,9 @@ private:
     bool m_isValid = false;
     QString m_lastError = "";
 
+    mutable QRecursiveMutex m_mutex;
+    QMutex                  m_writeMutex;
+
 };
 } // namespace Collett
 
@@ -0,0 +1,195 @@
+/*
+** Collett – Core Style Registry Class
+** ===================================
+**
+** This file is a part of Collett
+** Copyright 2020–2024, Veronica Berglyd Olsen
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "styleregistry.h"
+#include "formatcodec.h"
+
+#include <QFont>
+
+namespace Collett {
+
+/**
+ * Style Registry
+ * ==============
+ * Holds the block and char formats of each named text style. Every format
+ * carries its style ID in the StyleProperty, so a text block can be mapped
+ * back to its style without looking at its text.
+ *
+ * Each update bumps the registry version, and stamps the styles that were
+ * changed with the new version. A document restyled at an earlier version
+ * then only needs to touch blocks of styles with a newer version.
+ */
+
+StyleRegistry::StyleRegistry() {}
+
+/**
+ * Class Methods
+ * =============
+ */
+
+/**!
+ * @brief Rebuild the style formats from the text settings.
+ *
+ * Since the indentation of every style depends on the tab width, all styles
+ * are stamped as changed when it changes.
+ *
+ * @param fontSize the base font size in points.
+ * @param tabWidth the tab and indent width in pixels.
+ */
+void StyleRegistry::update(qreal fontSize, qreal tabWidth) {
+
+    bool tabChanged = m_version == 0 || tabWidth != m_tabWidth;
+    m_fontSize = fontSize;
+    m_tabWidth = tabWidth;
+    m_version++;
+
+    // Default Values
+
+    qreal defaultTopMargin = 0.5 * fontSize;
+    qreal defaultBottomMargin = 0.5 * fontSize;
+    qreal headerBottomMargin = 0.7 * fontSize;
+
+    const qreal headerScale[4] = {2.0, 1.7, 1.4, 1.2};
+
+    // Default Formats
+
+    QTextBlockFormat defaultBlockFmt;
+    defaultBlockFmt.setHeadingLevel(0);
+    defaultBlockFmt.setLineHeight(m_lineHeight, QTextBlockFormat::SingleHeight);
+    defaultBlockFmt.setTopMargin(defaultTopMargin);
+    defaultBlockFmt.setBottomMargin(defaultBottomMargin);
+    defaultBlockFmt.setTextIndent(0.0);
+
+    QTextCharFormat defaultCharFmt;
+    defaultCharFmt.setFontPointSize(fontSize);
+
+    this->setStyle(Default, defaultBlockFmt, defaultCharFmt, tabChanged);
+    this->setStyle(Paragraph, defaultBlockFmt, defaultCharFmt, tabChanged);
+
+    // Header Formats
+
+    for (int i = 0; i < 4; i++) {
+        qreal headerFontSize = headerScale[i] * fontSize;
+
+        QTextBlockFormat blockFmt = defaultBlockFmt;
+        blockFmt.setHeadingLevel(i + 1);
+        blockFmt.setTopMargin(headerFontSize);
+        blockFmt.setBottomMargin(headerBottomMargin);
+
+        QTextCharFormat charFmt = defaultCharFmt;
+        charFmt.setFontPointSize(headerFontSize);
+        charFmt.setFontWeight(QFont::Bold);
+
+        this->setStyle(static_cast<StyleId>(Header1 + i), blockFmt, charFmt, tabChanged);
+    }
+}
+
+/**
+ * Class Getters
+ * =============
+ */
+
+quint32 StyleRegistry::version() const {
+    return m_version;
+}
+
+/**!
+ * @brief The registry version a style was last changed in.
+ */
+quint32 StyleRegistry::styleVersion(StyleId style) const {
+    return m_styles.at(style).version;
+}
+
+qreal StyleRegistry::fontSize() const {
+    return m_fontSize;
+}
+
+qreal StyleRegistry::tabWidth() const {
+    return m_tabWidth;
+}
+
+qreal StyleRegistry::lineHeight() const {
+    return m_lineHeight;
+}
+
+const QTextBlockFormat &StyleRegistry::blockFormat(StyleId style) const {
+    return m_styles.at(style).blockFormat;
+}
+
+const QTextCharFormat &StyleRegistry::charFormat(StyleId style) const {
+    return m_styles.at(style).charFormat;
+}
+
+/**
+ * Static Methods
+ * ==============
+ */
+
+/**!
+ * @brief Get the style of a block format bitmask.
+ *
+ * @param blockFormat the block format bitmask.
+ * @return the style ID.
+ */
+StyleRegistry::StyleId StyleRegistry::styleForBlock(quint32 blockFormat) {
+    switch (blockFormat & FormatCodec::BlockTypeMask) {
+        case FormatCodec::BlockParagraph: return Paragraph;
+        case FormatCodec::BlockHeader1:   return Header1;
+        case FormatCodec::BlockHeader2:   return Header2;
+        case FormatCodec::BlockHeader3:   return Header3;
+        case FormatCodec::BlockHeader4:   return Header4;
+        default: return Default;
+    }
+}
+
+/**!
+ * @brief Get the style a text format was made from.
+ *
+ * @param format the block or char format.
+ * @return the style ID, or StyleCount if the format has none.
+ */
+StyleRegistry::StyleId StyleRegistry::styleOf(const QTextFormat &format) {
+    if (!format.hasProperty(StyleProperty)) {
+        return StyleCount;
+    }
+    int style = format.intProperty(StyleProperty);
+    return style >= 0 && style < StyleCount ? static_cast<StyleId>(style) : StyleCount;
+}
+
+/**
+ * Internal Functions
+ * ==================
+ */
+
+void StyleRegistry::setStyle(StyleId style, QTextBlockFormat blockFormat, QTextCharFormat charFormat, bool force) {
+
+    blockFormat.setProperty(StyleProperty, static_cast<int>(style));
+    charFormat.setProperty(StyleProperty, static_cast<int>(style));
+
+    Style &entry = m_styles[style];
+    if (force || entry.blockFormat != blockFormat || entry.charFormat != charFormat) {
+        entry.blockFormat = blockFormat;
+        entry.charFormat = charFormat;
+        entry.version = m_version;
+    }
+}
+
+} // namespace Collett
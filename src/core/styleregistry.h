@@ -0,0 +1,87 @@
+/*
+** Collett – Core Style Registry Class
+** ===================================
+**
+** This file is a part of Collett
+** Copyright 2020–2024, Veronica Berglyd Olsen
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef COLLETT_STYLE_REGISTRY_H
+#define COLLETT_STYLE_REGISTRY_H
+
+#include "collett.h"
+
+#include <array>
+
+#include <QTextBlockFormat>
+#include <QTextCharFormat>
+#include <QTextFormat>
+
+namespace Collett {
+
+class StyleRegistry
+{
+
+public:
+    enum StyleId {
+        Default, Paragraph, Header1, Header2, Header3, Header4, StyleCount
+    };
+
+    static constexpr int StyleProperty = QTextFormat::UserProperty + 1;
+
+    explicit StyleRegistry();
+    ~StyleRegistry() {};
+
+    // Class Methods
+
+    void update(qreal fontSize, qreal tabWidth);
+
+    // Class Getters
+
+    quint32 version() const;
+    quint32 styleVersion(StyleId style) const;
+    qreal fontSize() const;
+    qreal tabWidth() const;
+    qreal lineHeight() const;
+
+    const QTextBlockFormat &blockFormat(StyleId style) const;
+    const QTextCharFormat &charFormat(StyleId style) const;
+
+    // Static Methods
+
+    static StyleId styleForBlock(quint32 blockFormat);
+    static StyleId styleOf(const QTextFormat &format);
+
+private:
+    struct Style {
+        QTextBlockFormat blockFormat;
+        QTextCharFormat  charFormat;
+        quint32          version = 0;
+    };
+
+    std::array<Style, StyleCount> m_styles;
+
+    quint32 m_version = 0;
+    qreal   m_fontSize = 0.0;
+    qreal   m_tabWidth = 0.0;
+    qreal   m_lineHeight = 1.15;
+
+    void setStyle(StyleId style, QTextBlockFormat blockFormat, QTextCharFormat charFormat, bool force);
+
+};
+} // namespace Collett
+
+#endif // COLLETT_STYLE_REGISTRY_H
@@ -20,14 +20,18 @@
 */
 
 #include "svgiconengine.h"
+#include "iconatlas.h"
+#include "icons.h"
 
 #include <QApplication>
 #include <QByteArray>
 #include <QDebug>
+#include <QImage>
 #include <QPalette>
 #include <QIcon>
 #include <QPainter>
 #include <QPixmap>
+#include <QPixmapCache>
 #include <QRect>
 #include <QSize>
 #include <QSvgRenderer>
@@ -38,19 +42,19 @@ namespace Collett {
  * Custom Icon Engine
  * ==================
  * Based on: https://stackoverflow.com/a/44757951
+ *
+ * Icons are taken from the current icon atlas of CollettIcons, so a change
+ * of icon style only needs a repaint. Sizes that are not in the atlas are
+ * rendered from the icon's own SVG renderer, which is parsed once and
+ * shared with any clones. Pixmaps are kept in QPixmapCache, keyed on the
+ * icon style generation and the icon, size, mode, state and scale.
  */
 
-SVGIconEngine::SVGIconEngine(const QByteArray &normal, const QByteArray &active) :
-    m_iconNormal(normal), m_iconActive(active) {}
+SVGIconEngine::SVGIconEngine(int index) : m_index(index) {}
 
 void SVGIconEngine::paint(QPainter *painter, const QRect &rect, QIcon::Mode mode, QIcon::State state) {
-    if(mode == QIcon::Active) {
-        QSvgRenderer renderer(m_iconActive);
-        renderer.render(painter, rect);
-    } else {
-        QSvgRenderer renderer(m_iconNormal);
-        renderer.render(painter, rect);
-    }
+    qreal scale = painter->device() ? painter->device()->devicePixelRatioF() : 1.0;
+    painter->drawPixmap(rect, this->scaledPixmap(rect.size(), mode, state, scale));
 }
 
 QIconEngine *SVGIconEngine::clone() const {
@@ -58,15 +62,54 @@ QIconEngine *SVGIconEngine::clone() const {
 }
 
 QPixmap SVGIconEngine::pixmap(const QSize &size, QIcon::Mode mode, QIcon::State state) {
+    return this->scaledPixmap(size, mode, state, 1.0);
+}
+
+/**!
+ * @brief Get the icon rendered for a given device pixel ratio.
+ *
+ * @param size  the size of the icon in device independent pixels.
+ * @param mode  the icon mode.
+ * @param state the icon state.
+ * @param scale the device pixel ratio.
+ * @return the rendered pixmap.
+ */
+QPixmap SVGIconEngine::scaledPixmap(const QSize &size, QIcon::Mode mode, QIcon::State state, qreal scale) {
+
+    QSize pixSize = (QSizeF(size)*scale).toSize();
+    std::shared_ptr<const IconAtlas> atlas = CollettIcons::instance()->atlas();
+    if (pixSize.isEmpty() || !atlas) {
+        return QPixmap();
+    }
 
-    QImage img(size, QImage::Format_ARGB32);
-    img.fill(qRgba(0, 0, 0, 0));
-    QPixmap pix = QPixmap::fromImage(img, Qt::NoFormatConversion);
-    {
-        QPainter painter(&pix);
-        QRect rect(QPoint(0.0, 0.0), size);
-        this->paint(&painter, rect, mode, state);
+    QString key = QString("col_icon_%1_%2_%3x%4_%5_%6_%7")
+        .arg(atlas->generation()).arg(m_index).arg(pixSize.width()).arg(pixSize.height())
+        .arg(static_cast<int>(mode)).arg(static_cast<int>(state)).arg(scale);
+
+    QPixmap pix;
+    if (QPixmapCache::find(key, &pix)) {
+        return pix;
+    }
+
+    bool active = mode == QIcon::Active;
+    QImage img;
+    if (pixSize.width() == pixSize.height()) {
+        img = atlas->icon(m_index, pixSize.width(), active);
     }
+    if (img.isNull()) {
+        if (!m_renderer) {
+            m_renderer.reset(new QSvgRenderer(IconAtlas::iconSvg(m_index)));
+        }
+        img = QImage(pixSize, QImage::Format_ARGB32_Premultiplied);
+        img.fill(Qt::transparent);
+        QPainter painter(&img);
+        IconAtlas::paintIcon(painter, *m_renderer, img.rect(), active ? atlas->activeColor() : atlas->normalColor());
+    }
+
+    pix = QPixmap::fromImage(img, Qt::NoFormatConversion);
+    pix.setDevicePixelRatio(scale);
+    QPixmapCache::insert(key, pix);
+
     return pix;
 }
 
@@ -29,6 +29,9 @@
 #include <QPainter>
 #include <QByteArray>
 #include <QIconEngine>
+#include <QSharedPointer>
+#include <QString>
+#include <QSvgRenderer>
 
 namespace Collett {
 
@@ -36,15 +39,16 @@ class SVGIconEngine : public QIconEngine
 {
 
 public:
-    explicit SVGIconEngine(const QByteArray &normal, const QByteArray &active);
+    explicit SVGIconEngine(int index);
 
     void paint(QPainter *painter, const QRect &rect, QIcon::Mode mode, QIcon::State state) override;
     QIconEngine *clone() const override;
     QPixmap pixmap(const QSize &size, QIcon::Mode mode, QIcon::State state) override;
+    QPixmap scaledPixmap(const QSize &size, QIcon::Mode mode, QIcon::State state, qreal scale) override;
 
 private:
-    QByteArray m_iconNormal;
-    QByteArray m_iconActive;
+    int m_index;
+    QSharedPointer<QSvgRenderer> m_renderer;
 
 };
 } // namespace Collett
@@ -0,0 +1,395 @@
+/*
+** Collett – GUI Document Builder Class
+** ====================================
+**
+** This file is a part of Collett
+** Copyright 2020–2024, Veronica Berglyd Olsen
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "docbuilder.h"
+#include "formatcodec.h"
+#include "textedit.h"
+
+#include <algorithm>
+
+#include <QDebug>
+#include <QFont>
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QTextBlock>
+#include <QTextOption>
+
+namespace Collett {
+
+DocumentBuilder::DocumentBuilder(const StyleRegistry &styles)
+    : m_styles(styles)
+{}
+
+/**
+ * Class Methods
+ * =============
+ */
+
+/**!
+ * @brief Create an empty text document with the editor text options.
+ *
+ * Undo is disabled on the new document, and should be enabled when all
+ * content has been inserted.
+ *
+ * @return the new document, owned by the caller.
+ */
+std::unique_ptr<QTextDocument> DocumentBuilder::newDocument() const {
+
+    std::unique_ptr<QTextDocument> doc(new QTextDocument());
+    doc->setUndoRedoEnabled(false);
+
+    // Text Options
+    QTextOption opts;
+    opts.setWrapMode(QTextOption::WrapAtWordBoundaryOrAnywhere);
+    doc->setDefaultTextOption(opts);
+    doc->setDocumentMargin(40);
+
+    return doc;
+}
+
+/**!
+ * @brief Build a text document from JSON content.
+ *
+ * @param json the JSON content array.
+ * @return the new document, owned by the caller.
+ */
+std::unique_ptr<QTextDocument> DocumentBuilder::build(const QJsonArray &json) {
+
+    std::unique_ptr<QTextDocument> doc = this->newDocument();
+    QTextCursor cursor = QTextCursor(doc.get());
+
+    this->insertBlocks(cursor, json, 0, json.size(), true);
+
+    doc->setUndoRedoEnabled(true);
+    doc->setModified(false);
+
+    return doc;
+}
+
+/**!
+ * @brief Insert a range of JSON blocks at a cursor.
+ *
+ * When reuseBlock is set, the first block is written into the block the
+ * cursor is in, which should be empty. Otherwise every block is opened
+ * with a new block at the cursor. Each block is given its JSON object as
+ * block data.
+ *
+ * Every entry gives exactly one block, so that block numbers in the editor
+ * match the content indices. An entry that cannot be read gives an empty
+ * paragraph without block data.
+ *
+ * @param cursor     the cursor to insert at.
+ * @param json       the JSON content array.
+ * @param from       the index of the first block to insert.
+ * @param to         the index after the last block to insert.
+ * @param reuseBlock whether the first block goes into the cursor's block.
+ */
+void DocumentBuilder::insertBlocks(
+    QTextCursor &cursor, const QJsonArray &json, qsizetype from, qsizetype to, bool reuseBlock
+) {
+    bool isFirst = reuseBlock;
+    for (qsizetype i = from; i < to; ++i) {
+
+        QJsonValue jsonBlockValue = json.at(i);
+        if (!jsonBlockValue.isObject()) {
+            qWarning() << "Unexpected content in JSON array. Expected JSON object.";
+            this->openBlock(cursor, FormatCodec::BlockParagraph, isFirst);
+            cursor.block().setUserData(nullptr);
+            continue;
+        }
+
+        QJsonObject jsonBlock = jsonBlockValue.toObject();
+        quint32 blockFmt = FormatCodec::decodeBlockValue(jsonBlock.value(QLatin1String("u:fmt")));
+
+        this->openBlock(cursor, blockFmt, isFirst);
+        cursor.block().setUserData(new GuiTextBlockData(jsonBlock));
+
+        QJsonValue jsonText = jsonBlock.value(QLatin1String("u:txt"));
+        if (jsonText.isString()) {
+            this->insertFragment(cursor, blockFmt, jsonText.toString());
+        } else {
+            for (const QJsonValue &jsonFragValue : jsonBlock.value(QLatin1String("x:txt")).toArray()) {
+                this->insertFragment(cursor, blockFmt, jsonFragValue.toString());
+            }
+        }
+    }
+}
+
+/**!
+ * @brief Insert a range of blocks from a content reader at a cursor.
+ *
+ * This works like the JSON array version, but the blocks are decoded
+ * straight from the file data. The blocks get no JSON block data, and are
+ * serialised from the document when the content is first saved.
+ *
+ * @param cursor     the cursor to insert at.
+ * @param reader     the content reader.
+ * @param from       the index of the first block to insert.
+ * @param to         the index after the last block to insert.
+ * @param reuseBlock whether the first block goes into the cursor's block.
+ */
+void DocumentBuilder::insertBlocks(
+    QTextCursor &cursor, ContentReader &reader, qsizetype from, qsizetype to, bool reuseBlock
+) {
+    reader.setNewline(QChar::LineSeparator);
+
+    bool isFirst = reuseBlock;
+    for (qsizetype i = from; i < to; ++i) {
+
+        if (!reader.readBlock(i)) {
+            this->openBlock(cursor, FormatCodec::BlockParagraph, isFirst);
+            cursor.block().setUserData(nullptr);
+            continue;
+        }
+
+        const ContentBlock &block = reader.block();
+        quint32 blockFmt = FormatCodec::decodeBlock(block.format);
+
+        this->openBlock(cursor, blockFmt, isFirst);
+        cursor.block().setUserData(nullptr);
+
+        for (QStringView fragment : block.fragments) {
+            this->insertFragment(cursor, blockFmt, fragment);
+        }
+    }
+}
+
+/**!
+ * @brief Insert a range of blocks from a content table at a cursor.
+ *
+ * This works like the content reader version, but the formats and text of
+ * each run are read straight from the mapped table.
+ *
+ * @param cursor     the cursor to insert at.
+ * @param table      the opened content table.
+ * @param from       the index of the first block to insert.
+ * @param to         the index after the last block to insert.
+ * @param reuseBlock whether the first block goes into the cursor's block.
+ */
+void DocumentBuilder::insertBlocks(
+    QTextCursor &cursor, const ContentTable &table, qsizetype from, qsizetype to, bool reuseBlock
+) {
+    bool isFirst = reuseBlock;
+    for (qsizetype i = from; i < to; ++i) {
+
+        quint32 blockFmt = table.blockFormat(i);
+        this->openBlock(cursor, blockFmt, isFirst);
+        cursor.block().setUserData(nullptr);
+
+        for (qsizetype r = 0; r < table.runCount(i); ++r) {
+            quint32 charFmt = 0;
+            QString text = QString::fromUtf8(table.runText(i, r, charFmt));
+            if (charFmt == 0) {
+                // The fragment format could not be parsed when encoded
+                DocumentBuilder::insertText(cursor, text, cursor.charFormat());
+            } else if (charFmt & FormatCodec::CharText) {
+                DocumentBuilder::insertText(cursor, text, this->charFormat(blockFmt, charFmt));
+            }
+        }
+    }
+}
+
+/**
+ * Format Lookup
+ * =============
+ */
+
+/**!
+ * @brief Get the block format for a block format bitmask.
+ *
+ * Each distinct bitmask is built once from its style and cached until the
+ * text styles change.
+ *
+ * @param blockFmt the block format bitmask.
+ * @return the block format.
+ */
+const QTextBlockFormat &DocumentBuilder::blockFormat(quint32 blockFmt) {
+
+    this->checkStyles();
+    auto cached = m_blockFormats.constFind(blockFmt);
+    if (cached != m_blockFormats.constEnd()) {
+        return cached.value();
+    }
+
+    QTextBlockFormat blockFormat = m_styles.blockFormat(StyleRegistry::styleForBlock(blockFmt));
+
+    switch (blockFmt & FormatCodec::AlignMask) {
+        case FormatCodec::AlignLeft:    blockFormat.setAlignment(Qt::AlignLeading); break;
+        case FormatCodec::AlignCenter:  blockFormat.setAlignment(Qt::AlignHCenter); break;
+        case FormatCodec::AlignRight:   blockFormat.setAlignment(Qt::AlignTrailing); break;
+        case FormatCodec::AlignJustify: blockFormat.setAlignment(Qt::AlignJustify); break;
+        default: break;
+    }
+
+    if (blockFmt & FormatCodec::TextSegment) {
+        blockFormat.setTextIndent(-m_styles.tabWidth());
+        blockFormat.setLeftMargin(m_styles.tabWidth());
+    } else if (blockFmt & FormatCodec::TextIndent) {
+        blockFormat.setTextIndent(m_styles.tabWidth());
+    }
+
+    int indent = FormatCodec::indentLevel(blockFmt);
+    if (indent > 0) {
+        blockFormat.setIndent(indent);
+    }
+
+    return m_blockFormats.insert(blockFmt, blockFormat).value();
+}
+
+/**!
+ * @brief Get the char format for a text fragment.
+ *
+ * Each distinct combination of block style and char format bitmask is built
+ * once and cached until the text styles change.
+ *
+ * @param blockFmt the format bitmask of the block.
+ * @param charFmt  the char format bitmask of the fragment.
+ * @return the char format.
+ */
+const QTextCharFormat &DocumentBuilder::charFormat(quint32 blockFmt, quint32 charFmt) {
+
+    this->checkStyles();
+    quint32 key = ((blockFmt & FormatCodec::BlockTypeMask) << 16) | charFmt;
+    auto cached = m_charFormats.constFind(key);
+    if (cached != m_charFormats.constEnd()) {
+        return cached.value();
+    }
+
+    QTextCharFormat charFormat = m_styles.charFormat(StyleRegistry::styleForBlock(blockFmt));
+
+    if (charFmt & FormatCodec::CharBold) charFormat.setFontWeight(QFont::Bold);
+    if (charFmt & FormatCodec::CharItalic) charFormat.setFontItalic(true);
+    if (charFmt & FormatCodec::CharUnderline) charFormat.setFontUnderline(true);
+    if (charFmt & FormatCodec::CharStrike) charFormat.setFontStrikeOut(true);
+    if (charFmt & FormatCodec::CharSuper) charFormat.setVerticalAlignment(QTextCharFormat::AlignSuperScript);
+    if (charFmt & FormatCodec::CharSub) charFormat.setVerticalAlignment(QTextCharFormat::AlignSubScript);
+
+    return m_charFormats.insert(key, charFormat).value();
+}
+
+/**
+ * Internal Functions
+ * ==================
+ */
+
+/**!
+ * @brief Insert a text fragment like "3|text" at the cursor.
+ *
+ * @param cursor   the cursor to insert at.
+ * @param blockFmt the format bitmask of the block the fragment belongs to.
+ * @param fragment the fragment string.
+ */
+void DocumentBuilder::insertFragment(QTextCursor &cursor, quint32 blockFmt, QString fragment) {
+
+    quint32 charFmt = 0;
+    qsizetype fmtTagPos = FormatCodec::splitFragment(fragment, charFmt);
+    if (fmtTagPos < 0) {
+        qWarning() << "Could not parse format of text line";
+        DocumentBuilder::insertText(cursor, fragment, cursor.charFormat());
+        return;
+    }
+
+    if (charFmt & FormatCodec::CharText) {
+        DocumentBuilder::insertText(cursor, QStringView(fragment).sliced(fmtTagPos + 1), this->charFormat(blockFmt, charFmt));
+    }
+}
+
+/**!
+ * @brief Insert a decoded text fragment at the cursor.
+ *
+ * Line breaks are expected to be decoded as line separators already.
+ *
+ * @param cursor   the cursor to insert at.
+ * @param blockFmt the format bitmask of the block the fragment belongs to.
+ * @param fragment the fragment string.
+ */
+void DocumentBuilder::insertFragment(QTextCursor &cursor, quint32 blockFmt, QStringView fragment) {
+
+    quint32 charFmt = 0;
+    qsizetype fmtTagPos = FormatCodec::splitFragment(fragment, charFmt);
+    if (fmtTagPos < 0) {
+        qWarning() << "Could not parse format of text line";
+        DocumentBuilder::insertText(cursor, fragment, cursor.charFormat());
+        return;
+    }
+
+    if (charFmt & FormatCodec::CharText) {
+        DocumentBuilder::insertText(cursor, fragment.sliced(fmtTagPos + 1), this->charFormat(blockFmt, charFmt));
+    }
+}
+
+/**!
+ * @brief Start a new block at the cursor, or format the cursor's block if
+ * it is the first block and should be reused.
+ *
+ * @param cursor   the cursor to insert at.
+ * @param blockFmt the block format bitmask.
+ * @param isFirst  whether to reuse the cursor's block, cleared when used.
+ */
+void DocumentBuilder::openBlock(QTextCursor &cursor, quint32 blockFmt, bool &isFirst) {
+    if (isFirst) {
+        cursor.setBlockFormat(this->blockFormat(blockFmt));
+        isFirst = false;
+    } else {
+        cursor.insertBlock(this->blockFormat(blockFmt));
+    }
+}
+
+/**!
+ * @brief Insert text at the cursor without starting new blocks.
+ *
+ * QTextCursor starts a new block at every line feed, carriage return and
+ * paragraph separator. Each content entry must stay a single block, or the
+ * block indices of the editor would no longer match the content, so these
+ * are inserted as line separators instead. The text is only copied if it
+ * holds any of them.
+ *
+ * @param cursor the cursor to insert at.
+ * @param text   the text to insert.
+ * @param format the char format of the text.
+ */
+void DocumentBuilder::insertText(QTextCursor &cursor, QStringView text, const QTextCharFormat &format) {
+
+    auto isBreak = [](QChar c) {
+        return c == u'\n' || c == u'\r' || c == QChar::ParagraphSeparator;
+    };
+    if (std::none_of(text.begin(), text.end(), isBreak)) {
+        cursor.insertText(QString::fromRawData(text.data(), text.size()), format);
+        return;
+    }
+
+    QString lines = text.toString();
+    std::replace_if(lines.begin(), lines.end(), isBreak, QChar(QChar::LineSeparator));
+    cursor.insertText(lines, format);
+}
+
+/**!
+ * @brief Drop the cached formats if the text styles have changed.
+ */
+void DocumentBuilder::checkStyles() {
+    if (m_styleVersion != m_styles.version()) {
+        m_blockFormats.clear();
+        m_charFormats.clear();
+        m_styleVersion = m_styles.version();
+    }
+}
+
+} // namespace Collett
@@ -0,0 +1,79 @@
+/*
+** Collett – GUI Document Builder Class
+** ====================================
+**
+** This file is a part of Collett
+** Copyright 2020–2024, Veronica Berglyd Olsen
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef GUI_DOC_BUILDER_H
+#define GUI_DOC_BUILDER_H
+
+#include "collett.h"
+#include "contentreader.h"
+#include "contenttable.h"
+#include "styleregistry.h"
+
+#include <memory>
+
+#include <QHash>
+#include <QJsonArray>
+#include <QString>
+#include <QStringView>
+#include <QTextBlockFormat>
+#include <QTextCharFormat>
+#include <QTextCursor>
+#include <QTextDocument>
+
+namespace Collett {
+
+class DocumentBuilder
+{
+
+public:
+    explicit DocumentBuilder(const StyleRegistry &styles);
+    ~DocumentBuilder() {};
+
+    // Class Methods
+
+    std::unique_ptr<QTextDocument> newDocument() const;
+    std::unique_ptr<QTextDocument> build(const QJsonArray &json);
+    void insertBlocks(QTextCursor &cursor, const QJsonArray &json, qsizetype from, qsizetype to, bool reuseBlock);
+    void insertBlocks(QTextCursor &cursor, ContentReader &reader, qsizetype from, qsizetype to, bool reuseBlock);
+    void insertBlocks(QTextCursor &cursor, const ContentTable &table, qsizetype from, qsizetype to, bool reuseBlock);
+
+    const QTextBlockFormat &blockFormat(quint32 blockFmt);
+    const QTextCharFormat &charFormat(quint32 blockFmt, quint32 charFmt);
+
+private:
+    const StyleRegistry &m_styles;
+
+    // Format Caches
+
+    quint32 m_styleVersion = 0;
+    QHash<quint32, QTextBlockFormat> m_blockFormats;
+    QHash<quint32, QTextCharFormat>  m_charFormats;
+
+    void insertFragment(QTextCursor &cursor, quint32 blockFmt, QString fragment);
+    void insertFragment(QTextCursor &cursor, quint32 blockFmt, QStringView fragment);
+    void openBlock(QTextCursor &cursor, quint32 blockFmt, bool &isFirst);
+    static void insertText(QTextCursor &cursor, QStringView text, const QTextCharFormat &format);
+    void checkStyles();
+
+};
+} // namespace Collett
+
+#endif // GUI_DOC_BUILDER_H
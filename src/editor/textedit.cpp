@@ -20,11 +20,20 @@
 */
 
 #include "textedit.h"
+#include "docbuilder.h"
+#include "formatcodec.h"
 #include "settings.h"
 
 #include <algorithm>
+#include <tuple>
+#include <utility>
 
+#include <QAbstractTextDocumentLayout>
+#include <QElapsedTimer>
 #include <QFont>
+#include <QPoint>
+#include <QScrollBar>
+#include <QSet>
 #include <QWidget>
 #include <QDateTime>
 #include <QTextEdit>
@@ -32,10 +41,20 @@
 #include <QJsonValue>
 #include <QTextBlock>
 #include <QJsonObject>
-#include <QStringList>
 #include <QTextCursor>
 #include <QTextCharFormat>
 #include <QTextBlockFormat>
+#include <QVarLengthArray>
+
+// Blocks loaded on each side of the focus block before the editor opens
+#define COL_LOAD_WINDOW 200
+
+// Blocks inserted per batch, and milliseconds of loading per time slice
+#define COL_LOAD_BATCH 64
+#define COL_LOAD_SLICE 10
+
+// Milliseconds without edits before the changed blocks are reported
+#define COL_EDIT_DELAY 500
 
 namespace Collett {
 
@@ -43,14 +62,32 @@ GuiTextEdit::GuiTextEdit(QWidget *parent)
     : QTextEdit(parent)
 {
     // Settings
+    CollettSettings *settings = CollettSettings::instance();
+    m_styles = &settings->textStyles();
+    m_styleVersion = m_styles->version();
+
     this->setAcceptRichText(true);
     this->initDocument(this->document());
 
-    CollettSettings *settings = CollettSettings::instance();
-    m_format = settings->textFormat();
-
     connect(this, SIGNAL(cursorPositionChanged()),
             this, SLOT(processCursorPositionChanged()));
+    connect(this->document(), SIGNAL(contentsChange(int,int,int)),
+            this, SLOT(processContentsChange(int,int,int)));
+    connect(this, SIGNAL(redoAvailable(bool)),
+            this, SLOT(processRedoAvailable(bool)));
+    connect(settings, SIGNAL(textStylesChanged()),
+            this, SLOT(applyTextStyles()));
+
+    // Progressive Loading
+    m_loadTimer.setInterval(0);
+    connect(&m_loadTimer, SIGNAL(timeout()),
+            this, SLOT(loadPendingBlocks()));
+
+    // Edit Tracking
+    m_editTimer.setSingleShot(true);
+    m_editTimer.setInterval(COL_EDIT_DELAY);
+    connect(&m_editTimer, SIGNAL(timeout()),
+            this, SLOT(flushEdits()));
 }
 
 /**
@@ -79,233 +116,494 @@ bool GuiTextEdit::isModified() const {
 QJsonArray GuiTextEdit::toJsonContent() {
 
     QJsonArray json;
+    this->flushEdits();
 
     if (this->document()->blockCount() == 1 && this->document()->firstBlock().text().trimmed().isEmpty()) {
         // No text content
         return json;
     }
 
+    // Blocks keep their serialised JSON in their user data until they are
+    // changed, so only edited blocks are encoded again
     QTextBlock block = this->document()->firstBlock();
     while(block.isValid()) {
-        QJsonObject jsonBlock;
-        QJsonArray jsonFrags;
-        QStringList jsonBlockFmt;
+        GuiTextBlockData *blockData = static_cast<GuiTextBlockData*>(block.userData());
+        if (!blockData) {
+            blockData = new GuiTextBlockData(this->blockToJson(block));
+            block.setUserData(blockData);
+        }
+        json.append(blockData->json());
+        block = block.next();
+    }
 
-        QTextBlockFormat blockFormat = block.blockFormat();
+    return json;
+}
 
-        // Block Type
-        if (blockFormat.headingLevel() > 0) {
-            jsonBlockFmt << QString().setNum(blockFormat.headingLevel()).prepend("h");
-        } else {
-            jsonBlockFmt << "p";
-        }
+/**!
+ * @brief Replace the document with JSON content.
+ *
+ * The content is loaded progressively from the first block, so that no
+ * document is ever built in full on the GUI thread.
+ *
+ * @param json the JSON content array.
+ */
+void GuiTextEdit::setJsonContent(const QJsonArray &json) {
+    this->loadJsonContent(json, 0);
+}
 
-        // Block Alignment
-        switch (blockFormat.alignment()) {
-            case Qt::AlignLeading:  jsonBlockFmt << "al"; break;
-            case Qt::AlignCenter:   jsonBlockFmt << "ac"; break;
-            case Qt::AlignHCenter:  jsonBlockFmt << "ac"; break;
-            case Qt::AlignTrailing: jsonBlockFmt << "at"; break;
-            case Qt::AlignJustify:  jsonBlockFmt << "aj"; break;
-            default: jsonBlockFmt << "al"; break;
-        }
+/**!
+ * @brief Load JSON content progressively, starting around a given block.
+ *
+ * The blocks around the focus block are loaded straight away, and the
+ * document is editable, with undo, when this function returns. The rest of
+ * the blocks are inserted in time sliced batches from the event loop, first
+ * those after the loaded region and then those before it. Loading goes on
+ * while the document is edited.
+ *
+ * @param json       the JSON content array.
+ * @param focusBlock the block to put the cursor in.
+ */
+void GuiTextEdit::loadJsonContent(const QJsonArray &json, int focusBlock) {
+    this->stopLoading();
+    m_pendingJson = json;
+    this->startLoading(json.size(), focusBlock);
+}
 
-        // Text Indent
-        if (blockFormat.textIndent() > 0.0) {
-            jsonBlockFmt << "ti";
-        } else if (blockFormat.textIndent() < 0.0) {
-            jsonBlockFmt << "sg";
-        }
+/**!
+ * @brief Load content progressively, streamed by a content reader.
+ *
+ * This works like loadJsonContent, but the blocks are decoded straight
+ * from the file data by a ContentReader instead of from JSON objects.
+ *
+ * @param reader     an open content reader.
+ * @param focusBlock the block to put the cursor in.
+ */
+void GuiTextEdit::loadJsonReader(std::unique_ptr<ContentReader> reader, int focusBlock) {
+    this->stopLoading();
+    m_pendingReader.reset(reader.release());
+    this->startLoading(m_pendingReader->count(), focusBlock);
+}
 
-        // Block Indent
-        if (blockFormat.indent() > 0) {
-            jsonBlockFmt << QString().setNum(blockFormat.indent()).prepend("in");
-        }
+/**!
+ * @brief Check if blocks are still waiting to be loaded.
+ */
+bool GuiTextEdit::isLoading() const {
+    return m_pendingHead > 0 || m_pendingTail < m_pendingCount;
+}
 
-        // Write Format
-        jsonBlock.insert(QLatin1String("u:fmt"), jsonBlockFmt.join(":"));
+/**!
+ * @brief Get the content index of the block holding the cursor.
+ *
+ * Blocks still waiting to be loaded above the document are counted, so the
+ * index is valid while the document is loading.
+ */
+int GuiTextEdit::cursorBlock() {
+    this->syncLoadSteps();
+    return this->textCursor().blockNumber() + static_cast<int>(m_pendingHead);
+}
 
-        // Write Text
-        QTextBlock::Iterator blockIt = block.begin();
-        for (; !blockIt.atEnd(); ++blockIt) {
+/**!
+ * @brief Replace the editor document with a built document.
+ *
+ * This is the only place a built document changes owner. The editor takes
+ * it over as its child, and deletes the previous one if it owned that.
+ *
+ * @param newDoc the new document.
+ */
+void GuiTextEdit::setTextDocument(std::unique_ptr<QTextDocument> newDoc) {
 
-            QJsonObject jsonFrag;
-            QTextFragment blockFrag = blockIt.fragment();
-            QTextCharFormat fragFmt = blockFrag.charFormat();
+    QTextDocument *oldDoc = this->document();
+    QTextDocument *doc = newDoc.release();
 
-            QStringList jsonFragFmt;
+    doc->setParent(this);
+    connect(doc, SIGNAL(contentsChange(int,int,int)),
+            this, SLOT(processContentsChange(int,int,int)));
 
-            jsonFragFmt << "t";
-            if (fragFmt.fontWeight() > QFont::Medium) jsonFragFmt << "b";
-            if (fragFmt.fontItalic()) jsonFragFmt << "i";
-            if (fragFmt.fontUnderline()) jsonFragFmt << "u";
-            if (fragFmt.fontStrikeOut()) jsonFragFmt << "s";
-            if (fragFmt.verticalAlignment() == QTextCharFormat::AlignSuperScript) jsonFragFmt << "sup";
-            if (fragFmt.verticalAlignment() == QTextCharFormat::AlignSubScript) jsonFragFmt << "sub";
+    this->setDocument(doc);
+    this->setTabStopDistance(m_styles->tabWidth());
+    m_styleVersion = m_styles->version();
+    m_currentBlockNo = -1;
 
-            jsonFrags.append(jsonFragFmt.join(":") + "|" + blockFrag.text().replace(QChar::LineSeparator, '\n'));
-        }
+    // Edits recorded against the previous document no longer apply
+    m_editTimer.stop();
+    m_editAt = -1;
+    m_blockCount = doc->blockCount();
 
-        switch (jsonFrags.size()) {
-        case 0:
-            jsonBlock.insert(QLatin1String("u:txt"), "t|");
-            break;
-        case 1:
-            jsonBlock.insert(QLatin1String("u:txt"), jsonFrags.at(0));
-            break;
-        default:
-            jsonBlock.insert(QLatin1String("x:txt"), jsonFrags);
-            break;
-        }
+    for (QList<QTextCursor> &blocks : m_styleBlocks) {
+        blocks.clear();
+    }
+    this->indexBlocks(doc->firstBlock(), doc->lastBlock());
 
-        // Finish & Next
-        json.append(jsonBlock);
-        block = block.next();
+    if (oldDoc && oldDoc != doc && oldDoc->parent() == this) {
+        oldDoc->deleteLater();
     }
+}
 
-    return json;
+/**
+ * Internal Functions
+ * ==================
+ */
+
+/**!
+ * @brief Drop any blocks still waiting to be loaded, and the content source.
+ */
+void GuiTextEdit::stopLoading() {
+    m_loadTimer.stop();
+    m_pendingJson = QJsonArray();
+    m_pendingReader.reset();
+    m_pendingCount = 0;
+    m_pendingHead = 0;
+    m_pendingTail = 0;
+    m_loadSteps.clear();
+    m_reportedHead = 0;
+    m_reportedTail = 0;
+    m_builder.reset();
 }
 
-void GuiTextEdit::setJsonContent(const QJsonArray &json) {
+/**!
+ * @brief Start a progressive load of the pending content.
+ *
+ * The content source must be set before this is called.
+ *
+ * @param count      the number of blocks in the content.
+ * @param focusBlock the block to put the cursor in.
+ */
+void GuiTextEdit::startLoading(qsizetype count, int focusBlock) {
 
     qint64 start = QDateTime::currentMSecsSinceEpoch();
 
-    QTextDocument *doc = new QTextDocument(this);
+    qsizetype focus = std::clamp<qsizetype>(focusBlock, 0, std::max<qsizetype>(count - 1, 0));
+    qsizetype first = std::max<qsizetype>(focus - COL_LOAD_WINDOW, 0);
+    qsizetype last = std::min<qsizetype>(focus + COL_LOAD_WINDOW + 1, count);
+
+    m_builder.reset(new DocumentBuilder(*m_styles));
+
+    std::unique_ptr<QTextDocument> newDoc = m_builder->newDocument();
+    QTextDocument *doc = newDoc.get();
     QTextCursor cursor = QTextCursor(doc);
-    bool isFirst = true;
+    this->insertPending(cursor, first, last, true);
+    doc->setUndoRedoEnabled(true);
+    doc->setModified(false);
 
-    doc->setUndoRedoEnabled(false);
-    doc->clear();
-    initDocument(doc);
+    this->setTextDocument(std::move(newDoc));
+    this->setTextCursor(QTextCursor(doc->findBlockByNumber(focus - first)));
+    this->ensureCursorVisible();
+
+    m_pendingCount = count;
+    m_pendingHead = first;
+    m_pendingTail = last;
+    m_reportedHead = first;
+    m_reportedTail = last;
+    if (this->isLoading()) {
+        m_loadTimer.start();
+    } else {
+        this->finishLoading();
+    }
 
-    for (const QJsonValue &jsonBlockValue : json) {
+    qint64 end = QDateTime::currentMSecsSinceEpoch();
+    qDebug() << "Document editable in" << end - start << "ms";
+}
 
-        if (!jsonBlockValue.isObject()) {
-            qWarning() << "Unexpected content in JSON array. Expected JSON object.";
-            continue;
-        }
+/**!
+ * @brief Insert a range of pending blocks from the content source.
+ */
+void GuiTextEdit::insertPending(QTextCursor &cursor, qsizetype from, qsizetype to, bool reuseBlock) {
+    if (m_pendingReader) {
+        m_builder->insertBlocks(cursor, *m_pendingReader, from, to, reuseBlock);
+    } else {
+        m_builder->insertBlocks(cursor, m_pendingJson, from, to, reuseBlock);
+    }
+}
 
-        QStringList jsonBlockFmt;
-        QStringList jsonFrags;
-        QTextBlock newBlock;
+/**!
+ * @brief Insert pending blocks for a slice of time.
+ *
+ * Qt can only insert text without recording undo steps by switching undo
+ * off, and that clears the undo stack. While the stack is empty, blocks are
+ * inserted that way. Otherwise they are joined to the last undo step, so
+ * that loading never adds a step of its own, and the loaded range is
+ * recorded against the step. Undoing the step unloads the blocks again.
+ * Inserting would also drop any redo steps, so the load waits while there
+ * are any.
+ *
+ * @param slice the time to spend in milliseconds.
+ */
+void GuiTextEdit::insertPendingBlocks(qint64 slice) {
 
-        QJsonObject jsonBlock = jsonBlockValue.toObject();
-        if (jsonBlock.contains(QLatin1String("u:fmt"))) {
-            jsonBlockFmt = jsonBlock[QLatin1String("u:fmt")].toString().split(":");
-        }
+    QTextDocument *doc = this->document();
+    if (doc->availableRedoSteps() > 0) {
+        m_loadTimer.stop();
+        return;
+    }
 
-        QTextCharFormat  charFormat = m_format.charDefault;
-        QTextBlockFormat blockFormat = m_format.blockDefault;
-
-        // The first block format entry must describe the block type
-        if (!jsonBlockFmt.isEmpty()) {
-            QString blockFmtType = jsonBlockFmt.first();
-            if (blockFmtType == "p") {
-                charFormat = m_format.charParagraph;
-                blockFormat = m_format.blockParagraph;
-            } else if (blockFmtType == "h1") {
-                charFormat = m_format.charHeader1;
-                blockFormat = m_format.blockHeader1;
-            } else if (blockFmtType == "h2") {
-                charFormat = m_format.charHeader2;
-                blockFormat = m_format.blockHeader2;
-            } else if (blockFmtType == "h3") {
-                charFormat = m_format.charHeader3;
-                blockFormat = m_format.blockHeader3;
-            } else if (blockFmtType == "h4") {
-                charFormat = m_format.charHeader4;
-                blockFormat = m_format.blockHeader4;
-            }
-            jsonBlockFmt.removeFirst();
-        }
+    // Inserted head blocks shift the block indices of pending edits
+    this->flushEdits();
 
-        // The remaining block format entries describe the other format flags
-        for (const QString &blockFmtTag : jsonBlockFmt) {
-            if (blockFmtTag == "al") {
-                blockFormat.setAlignment(Qt::AlignLeading);
-            } else if (blockFmtTag == "ac") {
-                blockFormat.setAlignment(Qt::AlignHCenter);
-            } else if (blockFmtTag == "at") {
-                blockFormat.setAlignment(Qt::AlignTrailing);
-            } else if (blockFmtTag == "aj") {
-                blockFormat.setAlignment(Qt::AlignJustify);
-            } else if (blockFmtTag == "ti") {
-                blockFormat.setTextIndent(m_format.tabWidth);
-            } else if (blockFmtTag == "sg") {
-                blockFormat.setTextIndent(-m_format.tabWidth);
-                blockFormat.setLeftMargin(m_format.tabWidth);
-            } else if (blockFmtTag.startsWith("in")) {
-                blockFormat.setIndent(blockFmtTag.last(1).toInt());
-            }
-        }
+    QElapsedTimer timer;
+    timer.start();
 
-        if (isFirst) {
-            cursor.setBlockFormat(blockFormat);
-            isFirst = false;
+    bool isModified = doc->isModified();
+    bool joinUndo = doc->availableUndoSteps() > 0;
+    qsizetype head = m_pendingHead;
+    qsizetype tail = m_pendingTail;
+    qsizetype count = m_pendingCount;
+
+    m_insertingBlocks = true;
+    if (!joinUndo) {
+        doc->setUndoRedoEnabled(false);
+    }
+    while (this->isLoading() && timer.elapsed() < slice) {
+        if (m_pendingTail < count) {
+            qsizetype to = std::min<qsizetype>(m_pendingTail + COL_LOAD_BATCH, count);
+            this->insertTailBlocks(m_pendingTail, to);
+            m_pendingTail = to;
         } else {
-            cursor.insertBlock(blockFormat);
+            qsizetype from = std::max<qsizetype>(m_pendingHead - COL_LOAD_BATCH, 0);
+            this->insertHeadBlocks(from, m_pendingHead);
+            m_pendingHead = from;
         }
+    }
+    if (!joinUndo) {
+        doc->setUndoRedoEnabled(true);
+    }
+    m_insertingBlocks = false;
+    doc->setModified(isModified);
 
-        if (jsonBlock.contains(QLatin1String("u:txt"))) {
-            jsonFrags << jsonBlock[QLatin1String("u:txt")].toString();
-        } else if (jsonBlock.contains(QLatin1String("x:txt"))) {
-            for (const QJsonValue &jsonFragValue : jsonBlock[QLatin1String("x:txt")].toArray()) {
-                jsonFrags << jsonFragValue.toString();
-            }
-        }
+    if (joinUndo) {
+        m_loadSteps.append({doc->availableUndoSteps(), head, tail, m_pendingHead, m_pendingTail});
+    }
+    m_reportedHead = m_pendingHead;
+    m_reportedTail = m_pendingTail;
 
-        for (const QString &fragText : jsonFrags) {
+    if (this->isLoading()) {
+        emit loadProgress(int(m_pendingTail - m_pendingHead), int(count));
+    } else {
+        this->finishLoading();
+    }
+}
 
-            qsizetype fmtTagPos = fragText.indexOf("|");
-            if (fmtTagPos < 0) {
-                qWarning() << "Could not parse format of text line";
-                cursor.insertText(fragText);
-                continue;
-            }
+/**!
+ * @brief Wrap up a progressive load.
+ *
+ * The content source is kept while undo steps hold loaded blocks, since
+ * undoing them puts the blocks back into the pending range.
+ */
+void GuiTextEdit::finishLoading() {
 
-            QStringList fragCharFmt = fragText.first(fmtTagPos).split(":");
-            QString innerText = fragText.sliced(fmtTagPos + 1).replace('\n', QChar::LineSeparator);
-
-            QTextCharFormat fragFormat = charFormat;
-            bool isText = false;;
-            for (const QString &fragFmtTag : fragCharFmt) {
-                if (fragFmtTag == "t") {
-                    isText = true;
-                } else if (fragFmtTag == "b") {
-                    fragFormat.setFontWeight(QFont::Bold);
-                } else if (fragFmtTag == "i") {
-                    fragFormat.setFontItalic(true);
-                } else if (fragFmtTag == "u") {
-                    fragFormat.setFontUnderline(true);
-                } else if (fragFmtTag == "s") {
-                    fragFormat.setFontStrikeOut(true);
-                } else if (fragFmtTag == "sup") {
-                    fragFormat.setVerticalAlignment(QTextCharFormat::AlignSuperScript);
-                } else if (fragFmtTag == "sub") {
-                    fragFormat.setVerticalAlignment(QTextCharFormat::AlignSubScript);
-                }
-            }
+    m_loadTimer.stop();
+    emit loadProgress(int(m_pendingCount), int(m_pendingCount));
 
-            if (isText) {
-                cursor.insertText(innerText, fragFormat);
-            }
-        }
+    if (m_loadSteps.isEmpty()) {
+        this->stopLoading();
+    }
+}
 
+/**!
+ * @brief Update the loaded range after an undo or redo.
+ *
+ * The loaded range follows the undo state. Steps above it have been
+ * undone, and once the redo stack is gone, they can never be redone.
+ */
+void GuiTextEdit::syncLoadSteps() {
+
+    if (m_loadSteps.isEmpty()) {
+        return;
     }
 
-    doc->setUndoRedoEnabled(true);
-    doc->setModified(false);
+    QTextDocument *doc = this->document();
+    int undoSteps = doc->availableUndoSteps();
+    qsizetype applied = 0;
+    while (applied < m_loadSteps.size() && m_loadSteps.at(applied).undoSteps <= undoSteps) {
+        applied++;
+    }
 
-    this->setDocument(doc);
+    if (applied > 0) {
+        m_pendingHead = m_loadSteps.at(applied - 1).loadedHead;
+        m_pendingTail = m_loadSteps.at(applied - 1).loadedTail;
+    } else {
+        m_pendingHead = m_loadSteps.first().head;
+        m_pendingTail = m_loadSteps.first().tail;
+    }
 
-    qint64 end = QDateTime::currentMSecsSinceEpoch();
-    qDebug() << "Document loaded in" << end - start << "ms";
+    if (doc->availableRedoSteps() == 0) {
+        m_loadSteps.resize(applied);
+    }
 }
 
-/**
- * Internal Functions
- * ==================
+/**!
+ * @brief Merge an edit into the range of blocks waiting to be reported.
+ *
+ * The pending range replaces a range of the document as it was when last
+ * reported. A new edit is given in terms of the current document, and the
+ * merged range covers both, including any unchanged blocks between them.
+ *
+ * @param at      the index of the first changed block.
+ * @param removed the number of blocks the edit replaced.
+ * @param count   the number of blocks that replaced them.
+ */
+void GuiTextEdit::recordEdit(int at, int removed, int count) {
+
+    if (m_editAt < 0) {
+        m_editAt = at;
+        m_editRemoved = removed;
+        m_editCount = count;
+    } else {
+        int start = std::min(m_editAt, at);
+        int end = std::max(m_editAt + m_editCount, at + removed);
+        m_editRemoved = end - m_editCount + m_editRemoved - start;
+        m_editCount = end + count - removed - start;
+        m_editAt = start;
+    }
+
+    m_editTimer.start();
+}
+
+/**!
+ * @brief Insert pending blocks before the first block of the document.
+ *
+ * The first block is split so that the pending blocks can be written into
+ * a new empty block above it. The view is scrolled by the height of the
+ * inserted blocks so the visible text does not move.
+ *
+ * @param from the index of the first block to insert.
+ * @param to   the index after the last block to insert.
+ */
+void GuiTextEdit::insertHeadBlocks(qsizetype from, qsizetype to) {
+
+    QTextDocument *doc = this->document();
+    QAbstractTextDocumentLayout *layout = doc->documentLayout();
+    QScrollBar *vBar = this->verticalScrollBar();
+
+    QTextBlock topBlock = this->cursorForPosition(QPoint(0, 0)).block();
+    int topPos = topBlock.position();
+    int topOffset = vBar->value() - qRound(layout->blockBoundingRect(topBlock).top());
+    int charCount = doc->characterCount();
+
+    QTextBlock firstBlock = doc->firstBlock();
+    GuiTextBlockData *firstData = static_cast<GuiTextBlockData*>(firstBlock.userData());
+    QJsonObject firstJson = firstData ? firstData->json() : QJsonObject();
+
+    QTextCursor cursor = QTextCursor(doc);
+    cursor.joinPreviousEditBlock();
+    cursor.insertBlock(firstBlock.blockFormat(), firstBlock.charFormat());
+    doc->firstBlock().next().setUserData(firstData ? new GuiTextBlockData(firstJson) : nullptr);
+    cursor.setPosition(0);
+    this->insertPending(cursor, from, to, true);
+    cursor.endEditBlock();
+    this->indexBlocks(doc->firstBlock(), doc->findBlockByNumber(static_cast<int>(to - from - 1)));
+
+    topBlock = doc->findBlock(topPos + doc->characterCount() - charCount);
+    vBar->setValue(qRound(layout->blockBoundingRect(topBlock).top()) + topOffset);
+}
+
+/**!
+ * @brief Insert pending blocks after the last block of the document.
+ *
+ * @param from the index of the first block to insert.
+ * @param to   the index after the last block to insert.
  */
+void GuiTextEdit::insertTailBlocks(qsizetype from, qsizetype to) {
+
+    QTextDocument *doc = this->document();
+
+    // The editor cursor would otherwise be pushed along by text inserted
+    // at its position when it sits at the end of the document
+    QTextCursor editCursor = this->textCursor();
+    editCursor.setKeepPositionOnInsert(true);
+
+    QTextBlock lastBlock = doc->lastBlock();
+    QTextCursor cursor = QTextCursor(doc);
+    cursor.movePosition(QTextCursor::End);
+    cursor.joinPreviousEditBlock();
+    this->insertPending(cursor, from, to, false);
+    cursor.endEditBlock();
+    this->indexBlocks(lastBlock.next(), doc->lastBlock());
+
+    if (this->textCursor() != editCursor) {
+        editCursor.setKeepPositionOnInsert(false);
+        this->setTextCursor(editCursor);
+    }
+}
+
+/**!
+ * @brief Get the style of a text block.
+ *
+ * Blocks carry their style ID in their format. Blocks that have lost it,
+ * like pasted blocks, get the style of their format bitmask.
+ */
+StyleRegistry::StyleId GuiTextEdit::blockStyle(const QTextBlock &block) const {
+    QTextBlockFormat blockFormat = block.blockFormat();
+    StyleRegistry::StyleId style = StyleRegistry::styleOf(blockFormat);
+    if (style == StyleRegistry::StyleCount) {
+        style = StyleRegistry::styleForBlock(this->blockFormatMask(blockFormat));
+    }
+    return style;
+}
+
+/**!
+ * @brief Add a range of blocks to the style index.
+ *
+ * Paragraph blocks are not indexed. The blocks of the other styles are few,
+ * and each is tracked by a cursor, which Qt keeps in its block as the
+ * document is edited.
+ *
+ * @param block the first block of the range.
+ * @param last  the last block of the range.
+ */
+void GuiTextEdit::indexBlocks(QTextBlock block, const QTextBlock &last) {
+    while (block.isValid()) {
+        StyleRegistry::StyleId style = this->blockStyle(block);
+        if (style != StyleRegistry::Paragraph) {
+            QList<QTextCursor> &blocks = m_styleBlocks[style];
+            bool isIndexed = std::any_of(blocks.cbegin(), blocks.cend(), [&block](const QTextCursor &blockCursor) {
+                return blockCursor.block() == block;
+            });
+            if (!isIndexed) {
+                blocks.append(QTextCursor(block));
+            }
+        }
+        if (block == last) break;
+        block = block.next();
+    }
+}
+
+/**!
+ * @brief Apply the current formats of a style to a block.
+ *
+ * @param cursor  the cursor to apply the formats with.
+ * @param block   the block to restyle.
+ * @param style   the style of the block.
+ * @param builder the document builder holding the current formats.
+ * @return true if the style had changed, and the block was restyled.
+ */
+bool GuiTextEdit::restyleBlock(
+    QTextCursor &cursor, const QTextBlock &block, StyleRegistry::StyleId style, DocumentBuilder &builder
+) {
+    if (m_styles->styleVersion(style) <= m_styleVersion) {
+        return false;
+    }
+
+    quint32 blockFmt = this->blockFormatMask(block.blockFormat());
+
+    // The fragments are collected first, since changing their formats may
+    // merge them
+    QVarLengthArray<std::tuple<int, int, quint32>, 16> fragments;
+    for (QTextBlock::Iterator blockIt = block.begin(); !blockIt.atEnd(); ++blockIt) {
+        QTextFragment blockFrag = blockIt.fragment();
+        fragments.append({blockFrag.position(), blockFrag.length(), this->charFormatMask(blockFrag.charFormat())});
+    }
+
+    cursor.setPosition(block.position());
+    cursor.setBlockFormat(builder.blockFormat(blockFmt));
+    cursor.setBlockCharFormat(builder.charFormat(blockFmt, FormatCodec::CharText));
+    for (const auto &[position, length, charFmt] : fragments) {
+        cursor.setPosition(position);
+        cursor.setPosition(position + length, QTextCursor::KeepAnchor);
+        cursor.setCharFormat(builder.charFormat(blockFmt, charFmt));
+    }
+
+    return true;
+}
 
 void GuiTextEdit::initDocument(QTextDocument *doc) {
 
@@ -316,7 +614,105 @@ void GuiTextEdit::initDocument(QTextDocument *doc) {
     doc->setDocumentMargin(40);
 
     // Editor Options
-    this->setTabStopDistance(m_format.tabWidth);
+    this->setTabStopDistance(m_styles->tabWidth());
+}
+
+/**!
+ * @brief Serialise a single text block to its JSON object.
+ *
+ * @param block the text block.
+ * @return the JSON object with the block format and text fragments.
+ */
+QJsonObject GuiTextEdit::blockToJson(const QTextBlock &block) const {
+
+    QJsonObject jsonBlock;
+    QJsonArray jsonFrags;
+
+    // Write Format
+    jsonBlock.insert(QLatin1String("u:fmt"), static_cast<qint64>(this->blockFormatMask(block.blockFormat())));
+
+    // Write Text
+    QTextBlock::Iterator blockIt = block.begin();
+    for (; !blockIt.atEnd(); ++blockIt) {
+        QTextFragment blockFrag = blockIt.fragment();
+        quint32 charFmt = this->charFormatMask(blockFrag.charFormat());
+        jsonFrags.append(
+            FormatCodec::encodeFragment(charFmt, blockFrag.text().replace(QChar::LineSeparator, '\n'))
+        );
+    }
+
+    switch (jsonFrags.size()) {
+    case 0:
+        jsonBlock.insert(QLatin1String("u:txt"), FormatCodec::encodeFragment(FormatCodec::CharText, QStringView()));
+        break;
+    case 1:
+        jsonBlock.insert(QLatin1String("u:txt"), jsonFrags.at(0));
+        break;
+    default:
+        jsonBlock.insert(QLatin1String("x:txt"), jsonFrags);
+        break;
+    }
+
+    return jsonBlock;
+}
+
+/**!
+ * @brief Get the format bitmask of a block format.
+ *
+ * @param blockFormat the block format.
+ * @return the block format bitmask.
+ */
+quint32 GuiTextEdit::blockFormatMask(const QTextBlockFormat &blockFormat) const {
+
+    quint32 blockFmt = FormatCodec::BlockParagraph;
+
+    // Block Type
+    int hLevel = std::min(blockFormat.headingLevel(), 4);
+    if (hLevel > 0) {
+        blockFmt = FormatCodec::BlockHeader1 + hLevel - 1;
+    }
+
+    // Block Alignment
+    switch (blockFormat.alignment()) {
+        case Qt::AlignLeading:  blockFmt |= FormatCodec::AlignLeft; break;
+        case Qt::AlignCenter:   blockFmt |= FormatCodec::AlignCenter; break;
+        case Qt::AlignHCenter:  blockFmt |= FormatCodec::AlignCenter; break;
+        case Qt::AlignTrailing: blockFmt |= FormatCodec::AlignRight; break;
+        case Qt::AlignJustify:  blockFmt |= FormatCodec::AlignJustify; break;
+        default: blockFmt |= FormatCodec::AlignLeft; break;
+    }
+
+    // Text Indent
+    if (blockFormat.textIndent() > 0.0) {
+        blockFmt |= FormatCodec::TextIndent;
+    } else if (blockFormat.textIndent() < 0.0) {
+        blockFmt |= FormatCodec::TextSegment;
+    }
+
+    // Block Indent
+    int indent = std::clamp(blockFormat.indent(), 0, 9);
+    blockFmt |= static_cast<quint32>(indent) << FormatCodec::IndentShift;
+
+    return blockFmt;
+}
+
+/**!
+ * @brief Get the format bitmask of a text fragment's char format.
+ *
+ * @param charFormat the char format.
+ * @return the char format bitmask.
+ */
+quint32 GuiTextEdit::charFormatMask(const QTextCharFormat &charFormat) const {
+
+    quint32 charFmt = FormatCodec::CharText;
+    if (charFormat.fontWeight() > QFont::Medium) charFmt |= FormatCodec::CharBold;
+    if (charFormat.fontItalic()) charFmt |= FormatCodec::CharItalic;
+    if (charFormat.fontUnderline()) charFmt |= FormatCodec::CharUnderline;
+    if (charFormat.fontStrikeOut()) charFmt |= FormatCodec::CharStrike;
+    if (charFormat.verticalAlignment() == QTextCharFormat::AlignSuperScript) charFmt |= FormatCodec::CharSuper;
+    if (charFormat.verticalAlignment() == QTextCharFormat::AlignSubScript) charFmt |= FormatCodec::CharSub;
+
+    return charFmt;
 }
 
 /**
@@ -374,8 +770,8 @@ void GuiTextEdit::toggleSegmentFormat() {
             format.setTextIndent(0.0);
             format.setLeftMargin(0.0);
         } else {
-            format.setTextIndent(-m_format.tabWidth);
-            format.setLeftMargin(m_format.tabWidth);
+            format.setTextIndent(-m_styles->tabWidth());
+            format.setLeftMargin(m_styles->tabWidth());
         }
         cursor.setBlockFormat(format);
         emit currentBlockChanged(cursor.block());
@@ -390,7 +786,7 @@ void GuiTextEdit::toggleFirstLineIndent() {
             format.setTextIndent(0.0);
             format.setLeftMargin(0.0);
         } else {
-            format.setTextIndent(m_format.tabWidth);
+            format.setTextIndent(m_styles->tabWidth());
             format.setLeftMargin(0.0);
         }
         cursor.setBlockFormat(format);
@@ -437,27 +833,156 @@ void GuiTextEdit::applyBlockFormat(BlockFormat format, int hLevel) {
     cursor.beginEditBlock();
     cursor.setPosition(bPos, QTextCursor::MoveAnchor);
     cursor.setPosition(bPos + bLen - 1, QTextCursor::KeepAnchor);
+    StyleRegistry::StyleId style = StyleRegistry::StyleCount;
     if (format == BlockFormat::Paragraph && hLevelNow != 0) {
-        cursor.setBlockFormat(m_format.blockParagraph);
-        cursor.setCharFormat(m_format.charParagraph);
-    } else if (format == BlockFormat::Header && hLevel == 1) {
-        cursor.setBlockFormat(m_format.blockHeader1);
-        cursor.setCharFormat(m_format.charHeader1);
-    } else if (format == BlockFormat::Header && hLevel == 2) {
-        cursor.setBlockFormat(m_format.blockHeader2);
-        cursor.setCharFormat(m_format.charHeader2);
-    } else if (format == BlockFormat::Header && hLevel == 3) {
-        cursor.setBlockFormat(m_format.blockHeader3);
-        cursor.setCharFormat(m_format.charHeader3);
-    } else if (format == BlockFormat::Header && hLevel == 4) {
-        cursor.setBlockFormat(m_format.blockHeader4);
-        cursor.setCharFormat(m_format.charHeader4);
+        style = StyleRegistry::Paragraph;
+    } else if (format == BlockFormat::Header && hLevel >= 1 && hLevel <= 4) {
+        style = static_cast<StyleRegistry::StyleId>(StyleRegistry::Header1 + hLevel - 1);
+    }
+    if (style != StyleRegistry::StyleCount) {
+        cursor.setBlockFormat(m_styles->blockFormat(style));
+        cursor.setCharFormat(m_styles->charFormat(style));
     }
     cursor.endEditBlock();
 
     emit currentBlockChanged(cursor.block());
 }
 
+/**!
+ * @brief Restyle the document after the text styles have changed.
+ *
+ * Only blocks of styles that have changed since the document was last
+ * styled are touched. Paragraph blocks make up most of a document, so when
+ * their style has changed, the whole document is gone through. Otherwise
+ * only the blocks in the style index are. Restyling does not change the
+ * format bitmasks, so the cached JSON of the blocks is kept.
+ *
+ * Qt can only change formats without recording undo steps by switching undo
+ * off, and that clears the undo stack. The restyle is therefore only kept
+ * out of the undo history while the history is empty. Otherwise it is an
+ * undo step of its own, like any other format change.
+ */
+void GuiTextEdit::applyTextStyles() {
+
+    if (m_styleVersion == m_styles->version()) {
+        return;
+    }
+
+    qint64 start = QDateTime::currentMSecsSinceEpoch();
+
+    QTextDocument *doc = this->document();
+    bool isModified = doc->isModified();
+    bool keepUndo = doc->availableUndoSteps() > 0 || doc->availableRedoSteps() > 0;
+    DocumentBuilder builder(*m_styles);
+    int restyled = 0;
+
+    m_insertingBlocks = true;
+    if (!keepUndo) {
+        doc->setUndoRedoEnabled(false);
+    }
+
+    QTextCursor cursor = QTextCursor(doc);
+    cursor.beginEditBlock();
+    if (m_styles->styleVersion(StyleRegistry::Paragraph) > m_styleVersion) {
+        // The index is rebuilt on the way
+        for (QList<QTextCursor> &blocks : m_styleBlocks) {
+            blocks.clear();
+        }
+        for (QTextBlock block = doc->firstBlock(); block.isValid(); block = block.next()) {
+            StyleRegistry::StyleId style = this->blockStyle(block);
+            if (style != StyleRegistry::Paragraph) {
+                m_styleBlocks[style].append(QTextCursor(block));
+            }
+            if (this->restyleBlock(cursor, block, style, builder)) {
+                restyled++;
+            }
+        }
+    } else {
+        for (int i = 0; i < StyleRegistry::StyleCount; i++) {
+            StyleRegistry::StyleId style = static_cast<StyleRegistry::StyleId>(i);
+            if (m_styles->styleVersion(style) <= m_styleVersion) {
+                continue;
+            }
+            // Blocks that have changed style, or that were removed so that
+            // two cursors ended up in the same block, are dropped
+            QSet<int> visited;
+            m_styleBlocks[style].removeIf([&](const QTextCursor &blockCursor) {
+                QTextBlock block = blockCursor.block();
+                if (this->blockStyle(block) != style || visited.contains(block.position())) {
+                    return true;
+                }
+                visited.insert(block.position());
+                if (this->restyleBlock(cursor, block, style, builder)) {
+                    restyled++;
+                }
+                return false;
+            });
+        }
+    }
+    cursor.endEditBlock();
+
+    if (!keepUndo) {
+        doc->setUndoRedoEnabled(true);
+    }
+    doc->setModified(isModified);
+    m_insertingBlocks = false;
+
+    this->setTabStopDistance(m_styles->tabWidth());
+    m_styleVersion = m_styles->version();
+
+    qint64 end = QDateTime::currentMSecsSinceEpoch();
+    qDebug() << "Restyled" << restyled << "blocks in" << end - start << "ms";
+}
+
+/**!
+ * @brief Report the blocks changed since the last report.
+ *
+ * The changed blocks are serialised and kept as their cached JSON, and
+ * are reported as a splice of the full document content. Blocks that are
+ * still waiting to be loaded above the document are counted in the index.
+ *
+ * An undo or redo can unload or reload blocks at either end of the
+ * document. Those blocks are part of the changed range, but their content
+ * is unchanged, so they are left out of the report.
+ */
+void GuiTextEdit::flushEdits() {
+
+    m_editTimer.stop();
+    this->syncLoadSteps();
+
+    qsizetype unloadedHead = std::max<qsizetype>(m_pendingHead - m_reportedHead, 0);
+    qsizetype reloadedHead = std::max<qsizetype>(m_reportedHead - m_pendingHead, 0);
+    qsizetype unloadedTail = std::max<qsizetype>(m_reportedTail - m_pendingTail, 0);
+    qsizetype reloadedTail = std::max<qsizetype>(m_pendingTail - m_reportedTail, 0);
+    qsizetype reportedHead = m_reportedHead;
+    m_reportedHead = m_pendingHead;
+    m_reportedTail = m_pendingTail;
+
+    if (m_editAt < 0) {
+        return;
+    }
+
+    int at = m_editAt + static_cast<int>(reportedHead + unloadedHead);
+    int first = m_editAt + static_cast<int>(reloadedHead);
+    int count = m_editCount - static_cast<int>(reloadedHead + reloadedTail);
+    int removed = m_editRemoved - static_cast<int>(unloadedHead + unloadedTail);
+    m_editAt = -1;
+
+    QJsonArray inserted;
+    QTextBlock block = this->document()->findBlockByNumber(first);
+    for (int i = 0; i < count && block.isValid(); i++) {
+        GuiTextBlockData *blockData = static_cast<GuiTextBlockData*>(block.userData());
+        if (!blockData) {
+            blockData = new GuiTextBlockData(this->blockToJson(block));
+            block.setUserData(blockData);
+        }
+        inserted.append(blockData->json());
+        block = block.next();
+    }
+
+    emit contentEdited(at, std::max(removed, 0), inserted);
+}
+
 /**
  * Private Slots
  * =============
@@ -474,4 +999,65 @@ void GuiTextEdit::processCursorPositionChanged() {
     }
 }
 
+/**!
+ * @brief Resume a paused load when the redo steps are gone.
+ */
+void GuiTextEdit::processRedoAvailable(bool available) {
+    this->syncLoadSteps();
+    if (!available && this->isLoading()) {
+        m_loadTimer.start();
+    }
+}
+
+/**!
+ * @brief Load the next time slice of pending blocks.
+ */
+void GuiTextEdit::loadPendingBlocks() {
+    this->insertPendingBlocks(COL_LOAD_SLICE);
+}
+
+/**!
+ * @brief Drop the cached JSON of every block touched by an edit, and record
+ * the edit to be reported.
+ *
+ * Format changes are reported with equal removed and added counts, so the
+ * range from the position to the end of the added text covers them too.
+ * Blocks outside the range are unchanged, so the number of blocks the edit
+ * replaced follows from the change in the block count.
+ *
+ * @param position     the position of the change.
+ * @param charsRemoved the number of characters removed.
+ * @param charsAdded   the number of characters added.
+ */
+void GuiTextEdit::processContentsChange(int position, int charsRemoved, int charsAdded) {
+
+    Q_UNUSED(charsRemoved);
+
+    QTextDocument *doc = this->document();
+    int blockDelta = doc->blockCount() - m_blockCount;
+    m_blockCount = doc->blockCount();
+
+    if (m_insertingBlocks) {
+        // Blocks being loaded already carry their JSON, and restyled
+        // blocks keep theirs
+        return;
+    }
+
+    QTextBlock block = doc->findBlock(position);
+    QTextBlock last = doc->findBlock(position + charsAdded);
+    if (!last.isValid()) {
+        last = doc->lastBlock();
+    }
+
+    int count = last.blockNumber() - block.blockNumber() + 1;
+    this->recordEdit(block.blockNumber(), count - blockDelta, count);
+    this->indexBlocks(block, last);
+
+    while (block.isValid()) {
+        block.setUserData(nullptr);
+        if (block == last) break;
+        block = block.next();
+    }
+}
+
 } // namespace Collett
@@ -23,17 +23,41 @@
 #define GUI_TEXT_EDIT_H
 
 #include "collett.h"
-#include "settings.h"
+#include "contentreader.h"
+#include "docbuilder.h"
+#include "styleregistry.h"
 
+#include <array>
+#include <memory>
+
+#include <QList>
 #include <QWidget>
 #include <QTextEdit>
 #include <QJsonArray>
+#include <QJsonObject>
+#include <QScopedPointer>
 #include <QTextBlock>
+#include <QTextCursor>
+#include <QTextDocument>
 #include <QTextCharFormat>
 #include <QTextBlockFormat>
+#include <QTimer>
 
 namespace Collett {
 
+class GuiTextBlockData : public QTextBlockUserData
+{
+public:
+    explicit GuiTextBlockData(const QJsonObject &json) : m_json(json) {};
+    ~GuiTextBlockData() {};
+
+    const QJsonObject &json() const {return m_json;};
+
+private:
+    QJsonObject m_json;
+
+};
+
 class GuiTextEdit : public QTextEdit
 {
     Q_OBJECT
@@ -58,16 +82,77 @@ public:
 
     QJsonArray toJsonContent();
     void setJsonContent(const QJsonArray &json);
+    void loadJsonContent(const QJsonArray &json, int focusBlock);
+    void loadJsonReader(std::unique_ptr<ContentReader> reader, int focusBlock);
+    bool isLoading() const;
+    int cursorBlock();
 
 private:
-    CollettSettings::TextFormat m_format;
+    const StyleRegistry *m_styles;
+    quint32 m_styleVersion = 0;
 
     int m_currentBlockNo = -1;
 
+    // Edit Tracking
+
+    int    m_blockCount = 1;
+    int    m_editAt = -1;
+    int    m_editRemoved = 0;
+    int    m_editCount = 0;
+    QTimer m_editTimer;
+
+    // Progressive Loading
+
+    QScopedPointer<DocumentBuilder> m_builder;
+    QJsonArray m_pendingJson;
+    QScopedPointer<ContentReader> m_pendingReader;
+    qsizetype  m_pendingCount = 0;
+    qsizetype  m_pendingHead = 0;
+    qsizetype  m_pendingTail = 0;
+    QTimer     m_loadTimer;
+    bool       m_insertingBlocks = false;
+
+    // Pending blocks inserted while the undo stack holds edits are joined
+    // to the last undo step, and each step records the range it loaded
+    struct LoadStep {
+        int       undoSteps;
+        qsizetype head;
+        qsizetype tail;
+        qsizetype loadedHead;
+        qsizetype loadedTail;
+    };
+    QList<LoadStep> m_loadSteps;
+    qsizetype       m_reportedHead = 0;
+    qsizetype       m_reportedTail = 0;
+
+    // Style Index
+
+    std::array<QList<QTextCursor>, StyleRegistry::StyleCount> m_styleBlocks;
+
     void initDocument(QTextDocument *doc);
+    void setTextDocument(std::unique_ptr<QTextDocument> doc);
+    void stopLoading();
+    void startLoading(qsizetype count, int focusBlock);
+    void insertPending(QTextCursor &cursor, qsizetype from, qsizetype to, bool reuseBlock);
+    void insertPendingBlocks(qint64 slice);
+    void finishLoading();
+    void syncLoadSteps();
+    void recordEdit(int at, int removed, int count);
+    void insertHeadBlocks(qsizetype from, qsizetype to);
+    void insertTailBlocks(qsizetype from, qsizetype to);
+    StyleRegistry::StyleId blockStyle(const QTextBlock &block) const;
+    void indexBlocks(QTextBlock block, const QTextBlock &last);
+    bool restyleBlock(
+        QTextCursor &cursor, const QTextBlock &block, StyleRegistry::StyleId style, DocumentBuilder &builder
+    );
+    QJsonObject blockToJson(const QTextBlock &block) const;
+    quint32 blockFormatMask(const QTextBlockFormat &blockFormat) const;
+    quint32 charFormatMask(const QTextCharFormat &charFormat) const;
 
 signals:
     void currentBlockChanged(const QTextBlock &block);
+    void loadProgress(int loaded, int total);
+    void contentEdited(int at, int removed, const QJsonArray &inserted);
 
 public slots:
     void toggleBoldFormat();
@@ -82,9 +167,14 @@ public slots:
     void decreaseBlockIndent();
     void applyBlockAlignment(Qt::Alignment align);
     void applyBlockFormat(BlockFormat format, int hLevel);
+    void applyTextStyles();
+    void flushEdits();
 
 private slots:
     void processCursorPositionChanged();
+    void processContentsChange(int position, int charsRemoved, int charsAdded);
+    void processRedoAvailable(bool available);
+    void loadPendingBlocks();
 
 };
 } // namespace Collett
@@ -20,14 +20,22 @@
 */
 
 #include "guimain.h"
+#include "contentreader.h"
 #include "data.h"
+#include "icons.h"
 #include "maintoolbar.h"
 #include "settings.h"
 #include "textedit.h"
 
+#include <memory>
+#include <utility>
+
 #include <QApplication>
 #include <QCloseEvent>
+#include <QEvent>
 #include <QJsonArray>
+#include <QMessageBox>
+#include <QStatusBar>
 
 namespace Collett {
 
@@ -50,6 +58,10 @@ GuiMain::GuiMain(QWidget *parent) : QMainWindow(parent) {
     // Connect Signals
     // ===============
 
+    // ToolBar File Actions
+    connect(m_mainToolBar->m_saveFile, SIGNAL(triggered()),
+            this, SLOT(saveFile()));
+
     // ToolBar Paragraph Formatting
     connect(m_mainToolBar->m_formatHeading1, &QAction::triggered,
             [this]{m_textEditor->applyBlockFormat(GuiTextEdit::Header, 1);});
@@ -100,6 +112,18 @@ GuiMain::GuiMain(QWidget *parent) : QMainWindow(parent) {
     connect(m_textEditor, SIGNAL(currentBlockChanged(const QTextBlock&)),
             m_mainToolBar, SLOT(editorBlockChanged(const QTextBlock&)));
 
+    // Icon Style
+    connect(CollettIcons::instance(), SIGNAL(iconStyleChanged()),
+            m_mainToolBar, SLOT(update()));
+
+    // Document Loading
+    connect(m_textEditor, SIGNAL(loadProgress(int,int)),
+            this, SLOT(documentProgress(int,int)));
+
+    // Edit Journal
+    connect(m_textEditor, SIGNAL(contentEdited(int,int,const QJsonArray&)),
+            this, SLOT(journalEdit(int,int,const QJsonArray&)));
+
     return;
 }
 
@@ -114,13 +138,34 @@ GuiMain::~GuiMain() {
  */
 void GuiMain::openFile(const QString &path) {
 
+    m_editSerial = 0;
+    m_saveSerial = 0;
     m_data->openProject(path);
     if (!m_data->hasProject()) {
         return;
     }
 
-    QJsonArray jContent = m_data->project()->document().value(QLatin1String("x:content")).toArray();
-    this->m_textEditor->setJsonContent(jContent);
+    connect(m_data->project(), SIGNAL(saveFinished(bool)),
+            this, SLOT(projectSaved(bool)));
+
+    // The project opens even if journaled edits could not be recovered, but
+    // the user must know that they are missing
+    if (m_data->project()->hasError()) {
+        QMessageBox::warning(this, tr("Open Project"), m_data->project()->lastError());
+    }
+
+    // The editor opens on the region around the last cursor position, and
+    // loads the rest of the document in the background. Flat JSON projects
+    // are streamed straight from the file data
+    Project *project = m_data->project();
+    std::unique_ptr<ContentReader> reader = project->contentReader();
+    if (reader) {
+        m_textEditor->loadJsonReader(std::move(reader), project->cursorBlock());
+        return;
+    }
+
+    QJsonArray jContent = project->document().value(QLatin1String("x:content")).toArray();
+    m_textEditor->loadJsonContent(jContent, project->cursorBlock());
 }
 
 /**
@@ -140,11 +185,80 @@ bool GuiMain::closeMain() {
     return true;
 }
 
+/**
+ * Private Slots
+ * =============
+ */
+
+/**!
+ * @brief Save the project in the background.
+ *
+ * The editor reports its edits to the project as they are made, so only
+ * the edits not yet reported are flushed here. The document does not have
+ * to be loaded or serialised to save it.
+ */
+void GuiMain::saveFile() {
+
+    if (!m_data->hasProject()) {
+        return;
+    }
+
+    m_textEditor->flushEdits();
+    m_saveSerial = m_editSerial;
+    m_data->project()->setCursorBlock(m_textEditor->cursorBlock());
+    m_data->project()->saveProjectAsync();
+}
+
+/**!
+ * @brief Mark the document as unmodified when a save has succeeded.
+ *
+ * Edits made after the save was started are not covered by it, so the
+ * document stays modified if there are any.
+ */
+void GuiMain::projectSaved(bool success) {
+    if (success) {
+        if (m_editSerial == m_saveSerial) {
+            m_textEditor->setModified(false);
+        }
+        statusBar()->showMessage(tr("Project saved"), 2000);
+    } else {
+        statusBar()->showMessage(tr("Could not save project: %1").arg(m_data->project()->lastError()));
+    }
+}
+
+/**!
+ * @brief Record an editor change in the project's edit journal.
+ */
+void GuiMain::journalEdit(int at, int removed, const QJsonArray &inserted) {
+    m_editSerial++;
+    if (m_data->hasProject() && !m_data->project()->applyEdit(at, removed, inserted)) {
+        statusBar()->showMessage(tr("Could not record edit: %1").arg(m_data->project()->lastError()));
+    }
+}
+
+void GuiMain::documentProgress(int loaded, int total) {
+    if (loaded < total) {
+        statusBar()->showMessage(tr("Loading document: %1%").arg(100*loaded/total));
+    } else {
+        statusBar()->showMessage(tr("Document loaded"), 2000);
+    }
+}
+
 /**
  * Events
  * ======
  */
 
+/**!
+ * @brief Follow palette changes with the icon colours.
+ */
+void GuiMain::changeEvent(QEvent *event) {
+    if (event->type() == QEvent::PaletteChange) {
+        CollettIcons::instance()->updateIconStyle();
+    }
+    QMainWindow::changeEvent(event);
+}
+
 void GuiMain::closeEvent(QCloseEvent *event) {
     if (closeMain()) {
         event->accept();
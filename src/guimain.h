@@ -28,6 +28,7 @@
 #include "textedit.h"
 
 #include <QAction>
+#include <QJsonArray>
 #include <QMainWindow>
 
 namespace Collett {
@@ -50,10 +51,17 @@ public:
 
 private:
     CollettData *m_data;
+    qint64       m_editSerial = 0;
+    qint64       m_saveSerial = 0;
 
+    void changeEvent(QEvent *event) override;
     void closeEvent(QCloseEvent*);
 
 private slots:
+    void saveFile();
+    void projectSaved(bool success);
+    void journalEdit(int at, int removed, const QJsonArray &inserted);
+    void documentProgress(int loaded, int total);
 
 };
 } // namespace Collett
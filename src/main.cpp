@@ -22,14 +22,22 @@
 #include <iostream>
 
 #include "collett.h"
+#include "climain.h"
 #include "guimain.h"
 
 #include <QApplication>
 #include <QCommandLineOption>
+#include <QCoreApplication>
 #include <QCommandLineParser>
 #include <QDateTime>
 #include <QFile>
 #include <QFileInfo>
+#include <QGuiApplication>
+#include <QScopedPointer>
+#include <QStringList>
+
+// Log messages go to stderr in CLI mode, so they don't mix with results
+static std::ostream *logStream = &std::cout;
 
 /**!
  * @brief Log message handler
@@ -50,32 +58,67 @@ void collettLogHandler(QtMsgType type, const QMessageLogContext &context, const
     QString time = QDateTime::currentDateTime().toString(Qt::ISODateWithMs);
     QFileInfo file(context.file ? context.file : "");
 
-    std::cout << "[" << time.toStdString() << "] ";
+    *logStream << "[" << time.toStdString() << "] ";
     switch (type) {
-        case QtDebugMsg:    std::cout << "DEBUG     "; break;
-        case QtInfoMsg:     std::cout << "INFO      "; break;
-        case QtWarningMsg:  std::cout << "WARNING   "; break;
-        case QtCriticalMsg: std::cout << "CRITICAL  "; break;
-        case QtFatalMsg:    std::cout << "FATAL     "; break;
+        case QtDebugMsg:    *logStream << "DEBUG     "; break;
+        case QtInfoMsg:     *logStream << "INFO      "; break;
+        case QtWarningMsg:  *logStream << "WARNING   "; break;
+        case QtCriticalMsg: *logStream << "CRITICAL  "; break;
+        case QtFatalMsg:    *logStream << "FATAL     "; break;
     }
-    std::cout << msg.toStdString();
+    *logStream << msg.toStdString();
 #ifdef DEBUG
-    std::cout << " [" << file.fileName().toStdString() << ":" << context.line << "]";
+    *logStream << " [" << file.fileName().toStdString() << ":" << context.line << "]";
 #endif
-    std::cout << std::endl;
+    *logStream << std::endl;
 }
 
-int main(int argc, char *argv[]) {
-
-    qInstallMessageHandler(collettLogHandler);
-    QApplication app(argc, argv);
-
+/**!
+ * @brief Set the application meta data used by settings and the parser.
+ */
+void collettAppInfo() {
     QCoreApplication::setOrganizationName("Collett");
     QCoreApplication::setOrganizationDomain("vkbo.net");
     QCoreApplication::setApplicationName("Collett");
     QCoreApplication::setApplicationVersion(COL_VERSION_STR);
+}
+
+int main(int argc, char *argv[]) {
+
+    qInstallMessageHandler(collettLogHandler);
+
+    // Headless Commands
+    // A command as the first argument runs without creating any GUI. Only a
+    // PDF export needs a GUI application, for the fonts used to lay out the
+    // pages, and it always runs on the offscreen platform so that it works
+    // without a display, whatever platform the environment asks for.
+    if (argc > 1 && Collett::CliMain::isCommand(QString::fromLocal8Bit(argv[1]))) {
+        logStream = &std::cerr;
+
+        QStringList arguments;
+        for (int i = 0; i < argc; i++) {
+            arguments.append(QString::fromLocal8Bit(argv[i]));
+        }
+
+        QScopedPointer<QCoreApplication> app;
+        if (Collett::CliMain::needsGui(arguments)) {
+            qputenv("QT_QPA_PLATFORM", "offscreen");
+            app.reset(new QGuiApplication(argc, argv));
+        } else {
+            app.reset(new QCoreApplication(argc, argv));
+        }
+        collettAppInfo();
+        Collett::CliMain cli;
+        return cli.run(app->arguments());
+    }
+
+    QApplication app(argc, argv);
+    collettAppInfo();
 
     QCommandLineParser parser;
+    parser.setApplicationDescription(QCoreApplication::translate(
+        "main", "Run with convert, stats, export or validate as the first argument to run without a GUI."
+    ));
     parser.addHelpOption();
     parser.addVersionOption();
 